@@ -0,0 +1,342 @@
+//
+// Text to value and value to text, the way PG and Redis results are read and parameters
+// written, lex_cast and lex_format against boost::lexical_cast, a std::stringstream like
+// lex_cast used to be, and std::from_chars and std::to_chars by hand.
+//
+// Every iteration converts one set of realistic PG text output, 't'/'f', ids, numeric
+// prices, float8 and timestamps. time_per_op is per value converted, allocs_per_op the
+// heap allocations per value, counted by the operator new in this file.
+//
+// boost::lexical_cast<bool> doesn't read 't'/'f', it gets "1"/"0". The batch ones parse
+// the whole set in one call of parse_int64() or parse_double().
+//
+
+#include <benchmark/benchmark.h>
+#include <boost/lexical_cast.hpp>
+#define DB_BOOL_t_f
+#include <algorithm.h>
+#include <batch_parse.hpp>
+#include <decimal.hpp>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+std::atomic<uint64_t> g_allocations{0};
+
+}
+
+void *operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+// gcc sees malloc paired with operator new above and warns about free here
+#if defined __GNUC__ && !defined __clang__
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+namespace {
+
+using om_tools::lex_cast;
+using om_tools::lex_format;
+
+const std::vector<std::string> booleans = {"t", "f", "t", "t", "f", "f", "t", "f"};
+const std::vector<std::string> bits = {"1", "0", "1", "1", "0", "0", "1", "0"};
+const std::vector<std::string> ids = {"7", "42", "1024", "65535", "1234567", "2147483647", "-15", "300"};
+const std::vector<std::string> prices = {"12.50", "1999.99", "0.05", "123456.789", "-3.25", "100", "7.5",
+                                         "49.95"};
+const std::vector<std::string> float8s = {"3.141592653589793", "2.718281828459045", "1e-05", "6.02214076e+23",
+                                          "-0.5", "0.1", "1234.5678", "299792458"};
+const std::vector<std::string> timestamps = {"2024-03-05 14:07:09.123456+00", "2024-03-05 14:07:10+00",
+                                             "1999-12-31 23:59:59.999999+00", "2024-02-29 00:00:00+00",
+                                             "2024-03-05 14:07:09.5+00", "2038-01-19 03:14:07+00",
+                                             "1970-01-01 00:00:00+00", "2024-03-05 14:07:11.000001+00"};
+
+// lex_cast before from_chars, a stream for everything
+template<typename T>
+T stream_cast(std::string_view source) {
+    T out{};
+    std::stringstream ss;
+    ss << source;
+    ss >> out;
+    if (ss.fail() && std::is_arithmetic<T>::value) {
+        throw std::bad_cast();
+    }
+    return out;
+}
+
+template<typename T>
+T chars_cast(std::string_view source) {
+    T out{};
+    auto [end, error] = std::from_chars(source.data(), source.data() + source.size(), out);
+    if (error != std::errc()) {
+        throw std::bad_cast();
+    }
+    return out;
+}
+
+void report(benchmark::State &state, size_t per_iteration, uint64_t allocations) {
+    auto ops = static_cast<double>(state.iterations() * per_iteration);
+    state.SetItemsProcessed(static_cast<int64_t>(ops));
+    // seconds per value, shown as 12.3n for 12.3 ns
+    state.counters["time_per_op"] = benchmark::Counter(
+        static_cast<double>(per_iteration),
+        benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+    state.counters["allocs_per_op"] = static_cast<double>(allocations) / ops;
+}
+
+// convert every value in inputs, each iteration
+template<class CONVERT>
+void each(benchmark::State &state, const std::vector<std::string> &inputs, CONVERT convert) {
+    std::vector<std::string_view> views(inputs.begin(), inputs.end());
+    auto allocations = g_allocations.load(std::memory_order_relaxed);
+    for (auto _: state) {
+        for (std::string_view view: views) {
+            benchmark::DoNotOptimize(convert(view));
+        }
+    }
+    report(state, views.size(), g_allocations.load(std::memory_order_relaxed) - allocations);
+}
+
+// the whole set at once
+template<class PARSE>
+void batch(benchmark::State &state, const std::vector<std::string> &inputs, PARSE parse) {
+    std::vector<std::string_view> views(inputs.begin(), inputs.end());
+    auto allocations = g_allocations.load(std::memory_order_relaxed);
+    for (auto _: state) {
+        auto column = parse(views.data(), views.size());
+        benchmark::DoNotOptimize(column.values.data());
+    }
+    report(state, views.size(), g_allocations.load(std::memory_order_relaxed) - allocations);
+}
+
+// text to value
+
+void BM_bool_lex_cast(benchmark::State &state) {
+    each(state, booleans, [](std::string_view text) { return lex_cast<bool>(text); });
+}
+
+void BM_bool_stream(benchmark::State &state) {
+    each(state, bits, [](std::string_view text) { return stream_cast<bool>(text); });
+}
+
+void BM_bool_boost(benchmark::State &state) {
+    each(state, bits, [](std::string_view text) { return boost::lexical_cast<bool>(text); });
+}
+
+void BM_int_lex_cast(benchmark::State &state) {
+    each(state, ids, [](std::string_view text) { return lex_cast<int32_t>(text); });
+}
+
+void BM_int_stream(benchmark::State &state) {
+    each(state, ids, [](std::string_view text) { return stream_cast<int32_t>(text); });
+}
+
+void BM_int_boost(benchmark::State &state) {
+    each(state, ids, [](std::string_view text) { return boost::lexical_cast<int32_t>(text); });
+}
+
+void BM_int_from_chars(benchmark::State &state) {
+    each(state, ids, [](std::string_view text) { return chars_cast<int32_t>(text); });
+}
+
+void BM_int_batch(benchmark::State &state) {
+    batch(state, ids, [](const std::string_view *fields, size_t count) {
+        return om_tools::utilities::parse_int64(fields, count);
+    });
+}
+
+template<const std::vector<std::string> &INPUTS>
+void double_lex_cast(benchmark::State &state) {
+    each(state, INPUTS, [](std::string_view text) { return lex_cast<double>(text); });
+}
+
+template<const std::vector<std::string> &INPUTS>
+void double_stream(benchmark::State &state) {
+    each(state, INPUTS, [](std::string_view text) { return stream_cast<double>(text); });
+}
+
+template<const std::vector<std::string> &INPUTS>
+void double_boost(benchmark::State &state) {
+    each(state, INPUTS, [](std::string_view text) { return boost::lexical_cast<double>(text); });
+}
+
+template<const std::vector<std::string> &INPUTS>
+void double_from_chars(benchmark::State &state) {
+    each(state, INPUTS, [](std::string_view text) { return chars_cast<double>(text); });
+}
+
+template<const std::vector<std::string> &INPUTS>
+void double_batch(benchmark::State &state) {
+    batch(state, INPUTS, [](const std::string_view *fields, size_t count) {
+        return om_tools::utilities::parse_double(fields, count);
+    });
+}
+
+// exact, what a sum of prices should use
+void BM_numeric_decimal(benchmark::State &state) {
+    each(state, prices, [](std::string_view text) { return lex_cast<om_tools::utilities::Decimal<4>>(text); });
+}
+
+// what get_value<std::string> does with a timestamp
+void BM_timestamp_lex_cast(benchmark::State &state) {
+    each(state, timestamps, [](std::string_view text) { return lex_cast<std::string>(text); });
+}
+
+void BM_timestamp_stream(benchmark::State &state) {
+    each(state, timestamps, [](std::string_view text) { return stream_cast<std::string>(text); });
+}
+
+void BM_timestamp_boost(benchmark::State &state) {
+    each(state, timestamps, [](std::string_view text) { return boost::lexical_cast<std::string>(text); });
+}
+
+void BM_timestamp_string(benchmark::State &state) {
+    each(state, timestamps, [](std::string_view text) { return std::string(text); });
+}
+
+// value to text, like Params::add()
+
+template<class FORMAT>
+void format(benchmark::State &state, const std::vector<std::string> &inputs, FORMAT to_text) {
+    std::vector<double> values;
+    for (const auto &input: inputs) {
+        values.push_back(chars_cast<double>(input));
+    }
+    auto allocations = g_allocations.load(std::memory_order_relaxed);
+    for (auto _: state) {
+        for (double value: values) {
+            to_text(value);
+        }
+    }
+    report(state, values.size(), g_allocations.load(std::memory_order_relaxed) - allocations);
+}
+
+void BM_format_int_lex_format(benchmark::State &state) {
+    format(state, ids, [](double value) {
+        char buffer[om_tools::utilities::lex_format_size];
+        benchmark::DoNotOptimize(lex_format(buffer, static_cast<int32_t>(value)).data());
+    });
+}
+
+void BM_format_int_boost(benchmark::State &state) {
+    format(state, ids, [](double value) {
+        benchmark::DoNotOptimize(boost::lexical_cast<std::string>(static_cast<int32_t>(value)));
+    });
+}
+
+void BM_format_int_to_string(benchmark::State &state) {
+    format(state, ids, [](double value) {
+        benchmark::DoNotOptimize(std::to_string(static_cast<int32_t>(value)));
+    });
+}
+
+void BM_format_double_lex_format(benchmark::State &state) {
+    format(state, float8s, [](double value) {
+        char buffer[om_tools::utilities::lex_format_size];
+        benchmark::DoNotOptimize(lex_format(buffer, value).data());
+    });
+}
+
+void BM_format_double_boost(benchmark::State &state) {
+    format(state, float8s, [](double value) {
+        benchmark::DoNotOptimize(boost::lexical_cast<std::string>(value));
+    });
+}
+
+void BM_format_double_stream(benchmark::State &state) {
+    format(state, float8s, [](double value) {
+        std::ostringstream os;
+        os << value;
+        benchmark::DoNotOptimize(os.str());
+    });
+}
+
+void BM_format_decimal_lex_format(benchmark::State &state) {
+    format(state, prices, [](double value) {
+        char buffer[om_tools::utilities::lex_format_size];
+        auto price = om_tools::utilities::Decimal<4>::from_units(static_cast<int64_t>(value * 10000));
+        benchmark::DoNotOptimize(lex_format(buffer, price).data());
+    });
+}
+
+void BM_format_timestamp_lex_format(benchmark::State &state) {
+    format(state, ids, [](double value) {
+        char buffer[om_tools::utilities::lex_format_size];
+        std::chrono::system_clock::time_point time(std::chrono::seconds(static_cast<int64_t>(value) * 1000));
+        benchmark::DoNotOptimize(lex_format(buffer, time).data());
+    });
+}
+
+// what libpq_helper::Timestamp::to_string() does
+void BM_format_timestamp_strftime(benchmark::State &state) {
+    format(state, ids, [](double value) {
+        char buffer[25] = {};
+        tm time = {};
+        time_t t = static_cast<time_t>(value) * 1000;
+        ::localtime_r(&t, &time);
+        ::strftime(buffer, sizeof buffer, "%F %T", &time);
+        benchmark::DoNotOptimize(std::string(buffer));
+    });
+}
+
+}
+
+BENCHMARK(BM_bool_lex_cast);
+BENCHMARK(BM_bool_stream);
+BENCHMARK(BM_bool_boost);
+
+BENCHMARK(BM_int_lex_cast);
+BENCHMARK(BM_int_stream);
+BENCHMARK(BM_int_boost);
+BENCHMARK(BM_int_from_chars);
+BENCHMARK(BM_int_batch);
+
+BENCHMARK(double_lex_cast<prices>)->Name("BM_numeric_lex_cast");
+BENCHMARK(double_stream<prices>)->Name("BM_numeric_stream");
+BENCHMARK(double_boost<prices>)->Name("BM_numeric_boost");
+BENCHMARK(double_from_chars<prices>)->Name("BM_numeric_from_chars");
+BENCHMARK(double_batch<prices>)->Name("BM_numeric_batch");
+BENCHMARK(BM_numeric_decimal);
+
+BENCHMARK(double_lex_cast<float8s>)->Name("BM_float8_lex_cast");
+BENCHMARK(double_stream<float8s>)->Name("BM_float8_stream");
+BENCHMARK(double_boost<float8s>)->Name("BM_float8_boost");
+BENCHMARK(double_from_chars<float8s>)->Name("BM_float8_from_chars");
+BENCHMARK(double_batch<float8s>)->Name("BM_float8_batch");
+
+BENCHMARK(BM_timestamp_lex_cast);
+BENCHMARK(BM_timestamp_stream);
+BENCHMARK(BM_timestamp_boost);
+BENCHMARK(BM_timestamp_string);
+
+BENCHMARK(BM_format_int_lex_format);
+BENCHMARK(BM_format_int_boost);
+BENCHMARK(BM_format_int_to_string);
+BENCHMARK(BM_format_double_lex_format);
+BENCHMARK(BM_format_double_boost);
+BENCHMARK(BM_format_double_stream);
+BENCHMARK(BM_format_decimal_lex_format);
+BENCHMARK(BM_format_timestamp_lex_format);
+BENCHMARK(BM_format_timestamp_strftime);
+
+BENCHMARK_MAIN();
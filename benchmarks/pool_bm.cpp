@@ -0,0 +1,166 @@
+//
+// Acquire and release throughput and latency, no server needed, the connection is
+// in memory. Every pool setting gets the same load at 1 to 2x the number of cores,
+// run it on the box you size the pool for.
+//
+// BM_throughput is acquire and release as fast as it goes, BM_latency times each
+// acquire and release and reports the percentiles, the timing costs a bit of throughput.
+// open is the number of connections the pool ended up with, the percentiles are the
+// upper bound of a power of 2 bucket. The _fifo and _least_used variants are the same
+// with the other orderings, BM_throughput itself is the default Lifo.
+//
+
+#include <benchmark/benchmark.h>
+#include <connection_pool.hpp>
+#include <stats.hpp>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+using namespace om_tools::connection_pool;
+
+namespace {
+
+// no server, a connection that is always good
+struct Fake_connection {
+    uint64_t uses{0};
+
+    [[nodiscard]]
+    bool good_connection() const noexcept { return true; }
+
+    void reset() noexcept {}
+};
+
+typedef Pool<Fake_connection> fake_pool;
+typedef Pool<Fake_connection, Fifo> fifo_pool;
+typedef Pool<Fake_connection, Least_used> least_used_pool;
+
+template<class POOL>
+POOL *g_pool = nullptr;
+om_tools::stats::Histogram *g_latency = nullptr;
+
+int32_t max_threads() {
+    return static_cast<int32_t>(std::max(4u, 2 * std::thread::hardware_concurrency()));
+}
+
+template<class POOL>
+void set_up(benchmark::State &state, const Pool_config &config) {
+    if (state.thread_index() == 0) {
+        g_pool<POOL> = new POOL(config);
+        g_latency = new om_tools::stats::Histogram;
+    }
+}
+
+template<class POOL>
+void tear_down(benchmark::State &state) {
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index() == 0) {
+        // the others are done, the loop ends for all threads at once
+        auto stats = g_pool<POOL>->stats();
+        state.counters["open"] = static_cast<double>(stats.open);
+        state.counters["waits"] = static_cast<double>(stats.waits.waits);
+        auto latency = g_latency->snapshot();
+        if (latency.count) {
+            state.counters["p50_ns"] = static_cast<double>(latency.percentile(0.5).count());
+            state.counters["p99_ns"] = static_cast<double>(latency.percentile(0.99).count());
+            state.counters["p999_ns"] = static_cast<double>(latency.percentile(0.999).count());
+        }
+        delete g_latency;
+        g_latency = nullptr;
+        delete g_pool<POOL>;
+        g_pool<POOL> = nullptr;
+    }
+}
+
+template<class POOL>
+void throughput(benchmark::State &state, const Pool_config &config) {
+    set_up<POOL>(state, config);
+    for (auto _: state) {
+        auto connection = g_pool<POOL>->acquire();
+        ++connection->uses;
+    }
+    tear_down<POOL>(state);
+}
+
+template<class POOL>
+void latency(benchmark::State &state, const Pool_config &config) {
+    set_up<POOL>(state, config);
+    for (auto _: state) {
+        auto start = std::chrono::steady_clock::now();
+        {
+            auto connection = g_pool<POOL>->acquire();
+            ++connection->uses;
+        }
+        g_latency->record(std::chrono::steady_clock::now() - start);
+    }
+    tear_down<POOL>(state);
+}
+
+// the benchmark macros want plain function names
+void BM_throughput(benchmark::State &state, Pool_config config) {
+    throughput<fake_pool>(state, config);
+}
+
+void BM_throughput_fifo(benchmark::State &state, Pool_config config) {
+    throughput<fifo_pool>(state, config);
+}
+
+void BM_throughput_least_used(benchmark::State &state, Pool_config config) {
+    throughput<least_used_pool>(state, config);
+}
+
+void BM_latency(benchmark::State &state, Pool_config config) {
+    latency<fake_pool>(state, config);
+}
+
+void BM_latency_fifo(benchmark::State &state, Pool_config config) {
+    latency<fifo_pool>(state, config);
+}
+
+Pool_config shared() {
+    return Pool_config();
+}
+
+Pool_config thread_cache() {
+    Pool_config config;
+    config.thread_cache_size = 4;
+    return config;
+}
+
+// fewer connections than threads, the rest wait in line
+Pool_config bounded() {
+    Pool_config config;
+    config.max_size = 2;
+    config.acquire_timeout = std::chrono::minutes(1);
+    return config;
+}
+
+Pool_config slab() {
+    Pool_config config;
+    config.slab_size = 1024;
+    return config;
+}
+
+Pool_config timing() {
+    Pool_config config;
+    config.collect_timing = true;
+    return config;
+}
+
+}
+
+BENCHMARK_CAPTURE(BM_throughput, shared, shared())->ThreadRange(1, max_threads())->UseRealTime();
+BENCHMARK_CAPTURE(BM_throughput, thread_cache, thread_cache())->ThreadRange(1, max_threads())->UseRealTime();
+BENCHMARK_CAPTURE(BM_throughput, bounded, bounded())->ThreadRange(1, max_threads())->UseRealTime();
+BENCHMARK_CAPTURE(BM_throughput, slab, slab())->ThreadRange(1, max_threads())->UseRealTime();
+BENCHMARK_CAPTURE(BM_throughput, timing, timing())->ThreadRange(1, max_threads())->UseRealTime();
+BENCHMARK_CAPTURE(BM_throughput_fifo, shared, shared())->ThreadRange(1, max_threads())->UseRealTime();
+BENCHMARK_CAPTURE(BM_throughput_fifo, bounded, bounded())->ThreadRange(1, max_threads())->UseRealTime();
+BENCHMARK_CAPTURE(BM_throughput_least_used, shared, shared())->ThreadRange(1, max_threads())->UseRealTime();
+
+BENCHMARK_CAPTURE(BM_latency, shared, shared())->ThreadRange(1, max_threads())->UseRealTime();
+BENCHMARK_CAPTURE(BM_latency, thread_cache, thread_cache())->ThreadRange(1, max_threads())->UseRealTime();
+BENCHMARK_CAPTURE(BM_latency, bounded, bounded())->ThreadRange(1, max_threads())->UseRealTime();
+BENCHMARK_CAPTURE(BM_latency_fifo, shared, shared())->ThreadRange(1, max_threads())->UseRealTime();
+
+BENCHMARK_MAIN();
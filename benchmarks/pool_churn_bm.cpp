@@ -0,0 +1,53 @@
+//
+// Connection churn, every connection is discarded when it comes back, like when
+// Redis restarts or a database fails over, so every acquire creates a new one.
+// Compares the pool's slab against new/delete for each connection.
+//
+
+#include <benchmark/benchmark.h>
+#include <connection_pool.hpp>
+#include <array>
+
+using namespace om_tools::connection_pool;
+
+// about the size of a connection object with some buffers, no server needed
+struct Churn_connection {
+    std::array<char, 256> buffer{};
+    bool good{false};
+
+    [[nodiscard]]
+    bool good_connection() const noexcept { return good; }
+
+    void reset() noexcept {}
+};
+
+static void churn(benchmark::State &state, size_t slab_size) {
+    static Pool<Churn_connection> *pool = nullptr;
+    if (state.thread_index() == 0) {
+        Pool_config config;
+        config.slab_size = slab_size;
+        pool = new Pool<Churn_connection>(config);
+    }
+    for (auto _: state) {
+        auto connection = pool->acquire();
+        benchmark::DoNotOptimize(connection->buffer.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index() == 0) {
+        delete pool;
+        pool = nullptr;
+    }
+}
+
+static void BM_churn_heap(benchmark::State &state) {
+    churn(state, 0);
+}
+
+static void BM_churn_slab(benchmark::State &state) {
+    churn(state, 1024);
+}
+
+BENCHMARK(BM_churn_heap)->ThreadRange(1, 32)->UseRealTime();
+BENCHMARK(BM_churn_slab)->ThreadRange(1, 32)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -13,6 +13,7 @@ class AppOlaToolsConan(ConanFile):
         self.requires("boost/1.76.0")
         # self.requires("gtest/cci.20210126")
         self.requires("gtest/cci.20210126")
+        self.requires("benchmark/1.6.1")
         self.requires("zlib/1.2.12")
         self.requires("libpq/11.11")
         self.requires("libcurl/7.75.0")
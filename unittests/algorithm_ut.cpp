@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#define DB_BOOL_t_f
+#include <algorithm.h>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <typeinfo>
+
+using om_tools::lex_cast;
+
+TEST(lex_cast_test, integers) {
+    EXPECT_EQ(lex_cast<int>("10"), 10);
+    EXPECT_EQ(lex_cast<int>("-10"), -10);
+    EXPECT_EQ(lex_cast<int>("+10"), 10);
+    EXPECT_EQ(lex_cast<int>("  10"), 10);
+    EXPECT_EQ(lex_cast<int64_t>("9223372036854775807"), INT64_MAX);
+    EXPECT_EQ(lex_cast<uint16_t>("65535"), 65535);
+    // stops where the number does, like a stream
+    EXPECT_EQ(lex_cast<int>("0.7"), 0);
+    EXPECT_EQ(lex_cast<int>("42 rows"), 42);
+}
+
+TEST(lex_cast_test, integer_errors) {
+    EXPECT_THROW(lex_cast<int>(""), std::bad_cast);
+    EXPECT_THROW(lex_cast<int>("Ten"), std::bad_cast);
+    EXPECT_THROW(lex_cast<int>(".7"), std::bad_cast);
+    EXPECT_THROW(lex_cast<int>("+-1"), std::bad_cast);
+    EXPECT_THROW(lex_cast<int16_t>("40000"), std::bad_cast);
+    EXPECT_THROW(lex_cast<int64_t>("9223372036854775808"), std::bad_cast);
+    EXPECT_THROW(lex_cast<unsigned>("-1"), std::bad_cast);
+}
+
+TEST(lex_cast_test, floating_point) {
+    EXPECT_DOUBLE_EQ(lex_cast<double>("1.9"), 1.9);
+    EXPECT_DOUBLE_EQ(lex_cast<double>(".7"), 0.7);
+    EXPECT_DOUBLE_EQ(lex_cast<double>("-2.5e3"), -2500.0);
+    EXPECT_DOUBLE_EQ(lex_cast<double>("+3"), 3.0);
+    EXPECT_FLOAT_EQ(lex_cast<float>("0.25"), 0.25f);
+    EXPECT_THROW(lex_cast<double>("Ten"), std::bad_cast);
+    EXPECT_THROW(lex_cast<double>("1e999"), std::bad_cast);
+}
+
+TEST(lex_cast_test, booleans) {
+    EXPECT_TRUE(lex_cast<bool>("t"));
+    EXPECT_FALSE(lex_cast<bool>("f"));
+    EXPECT_TRUE(lex_cast<bool>("true"));
+    EXPECT_TRUE(lex_cast<bool>("1"));
+    EXPECT_FALSE(lex_cast<bool>("0"));
+    EXPECT_THROW(lex_cast<bool>("2"), std::bad_cast);
+    EXPECT_THROW(lex_cast<bool>(""), std::bad_cast);
+}
+
+TEST(lex_cast_test, stream_fallback) {
+    EXPECT_EQ(lex_cast<char>("x"), 'x');
+    EXPECT_EQ(lex_cast<std::string>("word"), "word");
+}
+
+TEST(lex_format_test, numbers) {
+    char buffer[om_tools::utilities::lex_format_size];
+    EXPECT_EQ(om_tools::lex_format(buffer, 0), "0");
+    EXPECT_EQ(om_tools::lex_format(buffer, -42), "-42");
+    EXPECT_EQ(om_tools::lex_format(buffer, INT64_MIN), "-9223372036854775808");
+    EXPECT_EQ(om_tools::lex_format(buffer, UINT64_MAX), "18446744073709551615");
+    // the shortest that reads back the same, not 786.87000000000001
+    EXPECT_EQ(om_tools::lex_format(buffer, 786.87), "786.87");
+    EXPECT_EQ(om_tools::lex_format(buffer, -1.5e-300), "-1.5e-300");
+    EXPECT_EQ(om_tools::lex_format(buffer, 0.1f), "0.1");
+    EXPECT_EQ(om_tools::lex_format(buffer, true), "1");
+    EXPECT_EQ(om_tools::lex_format(buffer, false), "0");
+    EXPECT_EQ(om_tools::lex_format(buffer, 'x'), "x");
+}
+
+TEST(lex_format_test, round_trip) {
+    char buffer[om_tools::utilities::lex_format_size];
+    for (double value: {0.1, 1.0 / 3, 1e300, -2.2250738585072014e-308, 123456789.125}) {
+        EXPECT_EQ(lex_cast<double>(om_tools::lex_format(buffer, value)), value);
+    }
+    for (int64_t value: {INT64_MIN, int64_t(-1), int64_t(0), INT64_MAX}) {
+        EXPECT_EQ(lex_cast<int64_t>(om_tools::lex_format(buffer, value)), value);
+    }
+    EXPECT_TRUE(lex_cast<bool>(om_tools::lex_format(buffer, true)));
+}
+
+TEST(lex_format_test, timestamps) {
+    using namespace std::chrono;
+    char buffer[om_tools::utilities::lex_format_size];
+    EXPECT_EQ(om_tools::lex_format(buffer, system_clock::time_point()), "1970-01-01 00:00:00+00");
+    // 2024-02-29 23:59:59.000123 UTC, a leap day
+    system_clock::time_point leap_day(seconds(1709251199) + microseconds(123));
+    EXPECT_EQ(om_tools::lex_format(buffer, leap_day), "2024-02-29 23:59:59.000123+00");
+    // before 1970 counts down
+    EXPECT_EQ(om_tools::lex_format(buffer, system_clock::time_point(-milliseconds(500))),
+              "1969-12-31 23:59:59.500000+00");
+    EXPECT_EQ(om_tools::lex_format(buffer, time_point<system_clock, seconds>(seconds(951782400))),
+              "2000-02-29 00:00:00+00");
+}
+
+TEST(lex_format_test, strings) {
+    char buffer[om_tools::utilities::lex_format_size];
+    std::string text = "as is";
+    // not copied, a view of the string itself
+    EXPECT_EQ(om_tools::lex_format(buffer, text).data(), text.data());
+    EXPECT_EQ(om_tools::lex_format(buffer, "literal"), "literal");
+
+    std::string arena;
+    om_tools::lex_format_to(arena, 42);
+    arena += ' ';
+    om_tools::lex_format_to(arena, std::string_view("and"));
+    arena += ' ';
+    om_tools::lex_format_to(arena, 0.5);
+    EXPECT_EQ(arena, "42 and 0.5");
+}
@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+#include <batch_parse.hpp>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace om_tools::utilities;
+
+namespace {
+
+const Simd all_simd[] = {Simd::scalar, Simd::sse4_2, Simd::avx2};
+
+std::vector<std::string_view> views(const std::vector<std::string> &strings) {
+    return {strings.begin(), strings.end()};
+}
+
+}
+
+TEST(batch_parse_test, int64) {
+    std::vector<std::string> text = {"0", "7", "-7", "+7", "1234567890123456", "12345678901234567",
+                                     "9223372036854775807", "-9223372036854775808", "0000000000000000000000042",
+                                     "-0"};
+    std::vector<int64_t> expected = {0, 7, -7, 7, 1234567890123456, 12345678901234567,
+                                     std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min(),
+                                     42, 0};
+    auto fields = views(text);
+    for (Simd simd: all_simd) {
+        auto column = parse_int64(fields.data(), fields.size(), simd);
+        EXPECT_TRUE(column.ok());
+        EXPECT_EQ(column.values, expected);
+    }
+}
+
+TEST(batch_parse_test, int64_errors) {
+    std::vector<std::string> text = {"1", "", "-", "42 rows", " 42", "1.5", "9223372036854775808",
+                                     "-9223372036854775809", "99999999999999999999", "--1", "12x4567890123456789", "2"};
+    auto fields = views(text);
+    for (Simd simd: all_simd) {
+        auto column = parse_int64(fields.data(), fields.size(), simd);
+        EXPECT_EQ(column.errors, (std::vector<size_t>{1, 2, 3, 4, 5, 6, 7, 8, 9, 10}));
+        EXPECT_EQ(column.values.front(), 1);
+        EXPECT_EQ(column.values[5], 0);
+        EXPECT_EQ(column.values.back(), 2);
+    }
+}
+
+TEST(batch_parse_test, double) {
+    std::vector<std::string> text = {"0", "1.5", "-2.25", ".5", "1.", "1e3", "-1.5E-3", "0.00123",
+                                     "123456789.123456789", "0.1", "1e23", "2.2250738585072014e-308",
+                                     "12345678901234567890123", "inf", "-nan", "+3.75"};
+    auto fields = views(text);
+    for (Simd simd: all_simd) {
+        auto column = parse_double(fields.data(), fields.size(), simd);
+        EXPECT_TRUE(column.ok());
+        for (size_t i = 0; i < text.size(); ++i) {
+            double expected = 0;
+            const char *first = text[i].c_str() + (text[i][0] == '+');
+            std::from_chars(first, text[i].c_str() + text[i].size(), expected);
+            if (expected != expected) {
+                EXPECT_NE(column.values[i], column.values[i]) << text[i];
+            } else {
+                // to the bit, not approximately
+                EXPECT_EQ(std::memcmp(&column.values[i], &expected, sizeof(double)), 0) << text[i];
+            }
+        }
+    }
+}
+
+TEST(batch_parse_test, double_errors) {
+    std::vector<std::string> text = {"", ".", "-", "e5", "1e", "1.5x", "1.2.3", "Ten", "1e999", " 1"};
+    auto fields = views(text);
+    for (Simd simd: all_simd) {
+        auto column = parse_double(fields.data(), fields.size(), simd);
+        EXPECT_EQ(column.errors.size(), text.size());
+    }
+}
+
+// many rounds, long and short fields mixed so the AVX2 pairs don't line up with the fields
+TEST(batch_parse_test, random) {
+    std::mt19937_64 random(42);
+    std::vector<std::string> integers;
+    std::vector<std::string> doubles;
+    for (int32_t i = 0; i < 5000; ++i) {
+        auto value = static_cast<int64_t>(random()) >> (random() % 64);
+        integers.push_back(std::to_string(value));
+        char buffer[64];
+        double number = static_cast<double>(value) / static_cast<double>(1 + random() % 100000);
+        auto end = std::to_chars(buffer, buffer + sizeof(buffer), number, std::chars_format::fixed,
+                                 static_cast<int>(random() % 12)).ptr;
+        doubles.emplace_back(buffer, end);
+    }
+    auto integer_fields = views(integers);
+    auto double_fields = views(doubles);
+    for (Simd simd: all_simd) {
+        auto column = parse_int64(integer_fields.data(), integer_fields.size(), simd);
+        ASSERT_TRUE(column.ok());
+        for (size_t i = 0; i < integers.size(); ++i) {
+            ASSERT_EQ(std::to_string(column.values[i]), integers[i]);
+        }
+        auto double_column = parse_double(double_fields.data(), double_fields.size(), simd);
+        ASSERT_TRUE(double_column.ok());
+        for (size_t i = 0; i < doubles.size(); ++i) {
+            double expected = 0;
+            std::from_chars(doubles[i].data(), doubles[i].data() + doubles[i].size(), expected);
+            ASSERT_EQ(double_column.values[i], expected) << doubles[i];
+        }
+    }
+}
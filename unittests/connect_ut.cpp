@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include <ip_socket.hpp>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using om_tools::Socket;
+using om_tools::descriptors::Connect_options;
+using namespace std::chrono_literals;
+
+namespace {
+
+uint16_t port_of(const Socket &socket) {
+    sockaddr_in address{};
+    socklen_t length = sizeof address;
+    ::getsockname(socket.get(), reinterpret_cast<sockaddr *>(&address), &length);
+    return ntohs(address.sin_port);
+}
+
+// a listener that takes no more clients, their SYNs are dropped like an unreachable host's
+struct Black_hole {
+    Socket listener = Socket::create_tcp_server_socket("0");
+    std::vector<Socket> queued;
+
+    Black_hole() {
+        ::listen(listener.get(), 0);
+        for (int i = 0; i < 2; ++i) {
+            Connect_options fill;
+            fill.attempt_timeout = 100ms;
+            auto connected = Socket::connect_tcp("127.0.0.1", std::to_string(port_of(listener)), fill);
+            if (connected) {
+                queued.push_back(std::move(connected.socket));
+            }
+        }
+    }
+};
+
+// a loopback address
+struct Address {
+    sockaddr_in in{};
+    addrinfo info{};
+
+    explicit Address(uint16_t port, Address *next = nullptr) {
+        in.sin_family = AF_INET;
+        in.sin_port = htons(port);
+        in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        info.ai_family = AF_INET;
+        info.ai_socktype = SOCK_STREAM;
+        info.ai_addr = reinterpret_cast<sockaddr *>(&in);
+        info.ai_addrlen = sizeof in;
+        info.ai_next = next ? &next->info : nullptr;
+    }
+};
+
+}
+
+TEST(connect_test, connects) {
+    auto server = Socket::create_tcp_server_socket("0");
+    auto connected = Socket::connect_tcp("127.0.0.1", std::to_string(port_of(server)));
+    ASSERT_TRUE(connected);
+    EXPECT_FALSE(connected.error);
+    EXPECT_GT(connected.latency.count(), 0);
+    EXPECT_LT(connected.latency, 1s);
+    // blocking again, like the other factories
+    EXPECT_EQ(::fcntl(connected.socket.get(), F_GETFL) & O_NONBLOCK, 0);
+
+    Connect_options options;
+    options.non_blocking = true;
+    auto non_blocking = Socket::connect_tcp("localhost", std::to_string(port_of(server)), options);
+    ASSERT_TRUE(non_blocking);
+    EXPECT_NE(::fcntl(non_blocking.socket.get(), F_GETFL) & O_NONBLOCK, 0);
+}
+
+TEST(connect_test, refused) {
+    uint16_t port;
+    {
+        auto closed = Socket::create_tcp_server_socket("0");
+        port = port_of(closed);
+    }
+    auto connected = Socket::connect_tcp("127.0.0.1", std::to_string(port));
+    EXPECT_FALSE(connected);
+    EXPECT_EQ(connected.error, std::errc::connection_refused);
+
+    EXPECT_FALSE(Socket::connect_tcp("no.such.host.invalid", "80"));
+}
+
+TEST(connect_test, times_out) {
+    Black_hole hole;
+    Connect_options options;
+    options.attempt_timeout = 100ms;
+    auto start = std::chrono::steady_clock::now();
+    auto connected = Socket::connect_tcp("127.0.0.1", std::to_string(port_of(hole.listener)), options);
+    auto took = std::chrono::steady_clock::now() - start;
+    EXPECT_FALSE(connected);
+    EXPECT_EQ(connected.error, std::errc::timed_out);
+    EXPECT_GE(took, 100ms);
+    EXPECT_LT(took, 1s);
+}
+
+TEST(connect_test, races_past_a_dead_address) {
+    Black_hole hole;
+    auto server = Socket::create_tcp_server_socket("0");
+    Address good(port_of(server));
+    Address dead(port_of(hole.listener), &good);
+
+    Connect_options options;
+    options.attempt_timeout = 5s;
+    options.stagger = 50ms;
+    auto connected = Socket::connect_tcp(&dead.info, options);
+    ASSERT_TRUE(connected);
+    // the second started after stagger, and won
+    EXPECT_GE(connected.latency, 50ms);
+    EXPECT_LT(connected.latency, 1s);
+    sockaddr_in peer{};
+    socklen_t length = sizeof peer;
+    ::getpeername(connected.socket.get(), reinterpret_cast<sockaddr *>(&peer), &length);
+    EXPECT_EQ(ntohs(peer.sin_port), port_of(server));
+}
+
+TEST(connect_test, failed_attempt_starts_the_next) {
+    uint16_t port;
+    {
+        auto closed = Socket::create_tcp_server_socket("0");
+        port = port_of(closed);
+    }
+    auto server = Socket::create_tcp_server_socket("0");
+    Address good(port_of(server));
+    Address refused(port, &good);
+    Connect_options options;
+    options.stagger = 2s;
+    auto connected = Socket::connect_tcp(&refused.info, options);
+    ASSERT_TRUE(connected);
+    // no waiting for stagger
+    EXPECT_LT(connected.latency, 1s);
+}
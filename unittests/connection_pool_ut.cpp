@@ -0,0 +1,845 @@
+
+#include <gtest/gtest.h>
+#include <connection_pool.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace om_tools::connection_pool;
+
+// in-memory connection, no server needed
+struct Fake_connection {
+    static inline std::atomic<int32_t> created{0};
+    static inline std::atomic<int32_t> destroyed{0};
+
+    std::atomic<bool> in_use{false};
+    bool good{true};
+    int32_t uses{0};
+
+    Fake_connection() { ++created; }
+
+    ~Fake_connection() { ++destroyed; }
+
+    [[nodiscard]]
+    bool good_connection() const noexcept { return good; }
+
+    void reset() noexcept {}
+};
+
+typedef Pool<Fake_connection> fake_pool;
+
+// the server may hang up on it while idle
+struct Probed_connection : Fake_connection {
+    // all of them, the dead ones are gone before they can be asked
+    static inline std::atomic<int32_t> all_probes{0};
+
+    bool server_alive{true};
+    int32_t probes{0};
+
+    bool test_connection() {
+        ++all_probes;
+        ++probes;
+        return server_alive;
+    }
+};
+
+TEST(connection_pool_test, reuses_connection) {
+    fake_pool pool;
+    Fake_connection *first = nullptr;
+    {
+        auto connection = pool.acquire();
+        first = &connection.get();
+    }
+    EXPECT_EQ(pool.idle(), 1u);
+    auto connection = pool.acquire();
+    EXPECT_EQ(&connection.get(), first);
+    EXPECT_EQ(pool.idle(), 0u);
+}
+
+// a and b come back in that order, then two are handed out one after the other
+template<class POOL>
+std::string handed_out() {
+    POOL pool;
+    std::optional<typename POOL::entry_type> a(pool.acquire());
+    std::optional<typename POOL::entry_type> b(pool.acquire());
+    Fake_connection *first = &a->get();
+    a.reset();
+    b.reset();
+    std::string order;
+    for (int32_t i = 0; i < 2; ++i) {
+        auto connection = pool.acquire();
+        order += &connection.get() == first ? 'a' : 'b';
+    }
+    return order;
+}
+
+TEST(connection_pool_test, ordering) {
+    EXPECT_EQ(handed_out<fake_pool>(), "bb");
+    EXPECT_EQ((handed_out<Pool<Fake_connection, Fifo>>()), "ab");
+    // both used once, then the other one
+    auto order = handed_out<Pool<Fake_connection, Least_used>>();
+    EXPECT_NE(order[0], order[1]);
+}
+
+TEST(connection_pool_test, drops_bad_connection) {
+    fake_pool pool;
+    auto destroyed = Fake_connection::destroyed.load();
+    {
+        auto connection = pool.acquire();
+        connection->good = false;
+    }
+    EXPECT_EQ(pool.idle(), 0u);
+    EXPECT_EQ(Fake_connection::destroyed.load(), destroyed + 1);
+}
+
+TEST(connection_pool_test, full_idle_stack_closes_connection) {
+    Pool_config config;
+    config.idle_capacity = 2;
+    fake_pool pool(config);
+    auto destroyed = Fake_connection::destroyed.load();
+    {
+        auto a = pool.acquire();
+        auto b = pool.acquire();
+        auto c = pool.acquire();
+    }
+    EXPECT_EQ(pool.idle(), 2u);
+    EXPECT_EQ(Fake_connection::destroyed.load(), destroyed + 1);
+}
+
+TEST(connection_pool_test, static_get_entry) {
+    Fake_connection *first = nullptr;
+    {
+        auto connection = fake_pool::get_entry();
+        first = &connection.get();
+    }
+    auto connection = fake_pool::get_entry();
+    EXPECT_EQ(&connection.get(), first);
+}
+
+TEST(connection_pool_test, thread_cache) {
+    Pool_config config;
+    config.thread_cache_size = 2;
+    fake_pool pool(config);
+    Fake_connection *first = nullptr;
+    {
+        auto connection = pool.acquire();
+        first = &connection.get();
+    }
+    // kept by this thread, not in the shared stack
+    EXPECT_EQ(pool.idle(), 0u);
+    {
+        auto connection = pool.acquire();
+        EXPECT_EQ(&connection.get(), first);
+    }
+    // another thread can't see it until this thread's cache is full
+    std::thread([&pool, first] {
+        auto connection = pool.acquire();
+        EXPECT_NE(&connection.get(), first);
+    }).join();
+    // the other thread exited and handed its connection back
+    EXPECT_EQ(pool.idle(), 1u);
+}
+
+TEST(connection_pool_test, bounded_timeout) {
+    Pool_config config;
+    config.max_size = 1;
+    config.acquire_timeout = std::chrono::milliseconds(10);
+    fake_pool pool(config);
+    auto connection = pool.acquire();
+    EXPECT_EQ(pool.open(), 1u);
+    EXPECT_FALSE(pool.try_acquire(std::chrono::milliseconds(10)));
+    EXPECT_THROW(pool.acquire(), Pool_timeout);
+    auto stats = pool.wait_stats();
+    EXPECT_EQ(stats.waits, 2u);
+    EXPECT_EQ(stats.timeouts, 2u);
+    EXPECT_GE(stats.max_wait, std::chrono::milliseconds(10));
+    EXPECT_EQ(pool.open(), 1u);
+}
+
+TEST(connection_pool_test, bounded_hand_over) {
+    Pool_config config;
+    config.max_size = 1;
+    fake_pool pool(config);
+    Fake_connection *first = nullptr;
+    std::atomic<bool> waiting{false};
+    std::thread waiter;
+    {
+        auto connection = pool.acquire();
+        first = &connection.get();
+        waiter = std::thread([&pool, &waiting, first] {
+            waiting = true;
+            auto entry = pool.try_acquire(std::chrono::seconds(10));
+            ASSERT_TRUE(entry);
+            EXPECT_EQ(&entry->get(), first);
+        });
+        while (!waiting || pool.wait_stats().waiting == 0) {
+            std::this_thread::yield();
+        }
+    }
+    waiter.join();
+    EXPECT_EQ(pool.open(), 1u);
+    EXPECT_EQ(pool.wait_stats().timeouts, 0u);
+}
+
+TEST(connection_pool_test, bounded_bad_connection_frees_slot) {
+    Pool_config config;
+    config.max_size = 1;
+    fake_pool pool(config);
+    {
+        auto connection = pool.acquire();
+        connection->good = false;
+    }
+    EXPECT_EQ(pool.open(), 0u);
+    auto connection = pool.try_acquire(std::chrono::milliseconds(0));
+    EXPECT_TRUE(connection);
+}
+
+TEST(connection_pool_test, reap_idle) {
+    Pool_config config;
+    config.idle_ttl = std::chrono::milliseconds(20);
+    config.min_idle = 2;
+    fake_pool pool(config);
+    {
+        auto a = pool.acquire();
+        auto b = pool.acquire();
+        auto c = pool.acquire();
+    }
+    EXPECT_EQ(pool.reap(), 0u);
+    EXPECT_EQ(pool.idle(), 3u);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    {
+        // used again, fresh
+        auto a = pool.acquire();
+    }
+    // one fresh and one expired kept for min_idle
+    EXPECT_EQ(pool.reap(), 1u);
+    EXPECT_EQ(pool.idle(), 2u);
+    EXPECT_EQ(pool.open(), 2u);
+}
+
+TEST(connection_pool_test, reap_during_acquire) {
+    Pool_config config;
+    config.idle_ttl = std::chrono::milliseconds(10);
+    config.reap_interval = std::chrono::milliseconds(10);
+    fake_pool pool(config);
+    {
+        auto a = pool.acquire();
+        auto b = pool.acquire();
+    }
+    EXPECT_EQ(pool.idle(), 2u);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    auto a = pool.acquire();
+    EXPECT_EQ(pool.idle(), 0u);
+    EXPECT_EQ(pool.open(), 1u);
+}
+
+TEST(connection_pool_test, warm) {
+    fake_pool pool;
+    auto results = pool.warm(8, 3);
+    EXPECT_EQ(results.size(), 8u);
+    for (const auto &result: results) {
+        EXPECT_TRUE(result.good);
+    }
+    EXPECT_EQ(pool.idle(), 8u);
+    EXPECT_EQ(pool.open(), 8u);
+}
+
+TEST(connection_pool_test, warm_bounded) {
+    Pool_config config;
+    config.max_size = 4;
+    fake_pool pool(config);
+    auto connection = pool.acquire();
+    EXPECT_EQ(pool.warm(8).size(), 3u);
+    EXPECT_EQ(pool.idle(), 3u);
+    EXPECT_EQ(pool.open(), 4u);
+}
+
+// idle in the shared stack, or in the thread's cache
+void validate_after_idle(size_t thread_cache_size) {
+    Pool_config config;
+    config.validate_after = std::chrono::milliseconds(20);
+    config.thread_cache_size = thread_cache_size;
+    Pool<Probed_connection> pool(config);
+    Probed_connection::all_probes = 0;
+    Probed_connection *first = nullptr;
+    {
+        auto connection = pool.acquire();
+        first = &connection.get();
+    }
+    {
+        // recently used, no probe
+        auto connection = pool.acquire();
+        EXPECT_EQ(&connection.get(), first);
+        EXPECT_EQ(connection->probes, 0);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    {
+        // idle too long, probed and still good
+        auto connection = pool.acquire();
+        EXPECT_EQ(&connection.get(), first);
+        EXPECT_EQ(connection->probes, 1);
+        connection->server_alive = false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    // probed, found dead and replaced
+    auto connection = pool.acquire();
+    EXPECT_EQ(Probed_connection::all_probes.load(), 2);
+    EXPECT_EQ(connection->probes, 0);
+    EXPECT_TRUE(connection->server_alive);
+    EXPECT_EQ(pool.stats().evictions, 1u);
+    EXPECT_EQ(pool.open(), 1u);
+    EXPECT_EQ(pool.idle(), 0u);
+}
+
+TEST(connection_pool_test, validate_after_idle) {
+    validate_after_idle(0);
+}
+
+TEST(connection_pool_test, validate_after_thread_cache) {
+    validate_after_idle(2);
+}
+
+// knows where it is connected
+struct Keyed_connection : Fake_connection {
+    std::string endpoint;
+
+    explicit Keyed_connection(const std::string &key) : endpoint(key) {}
+};
+
+TEST(connection_pool_test, keyed) {
+    Keyed_pool<Keyed_connection> pools;
+    Keyed_connection *first = nullptr;
+    {
+        auto a = pools.acquire("host=a dbname=tenant_1");
+        auto b = pools.acquire("host=b dbname=tenant_2");
+        EXPECT_EQ(a->endpoint, "host=a dbname=tenant_1");
+        EXPECT_EQ(b->endpoint, "host=b dbname=tenant_2");
+        first = &a.get();
+    }
+    EXPECT_EQ(pools.size(), 2u);
+    EXPECT_EQ(pools.pool("host=a dbname=tenant_1").idle(), 1u);
+    auto a = pools.acquire(std::string("host=a dbname=tenant_1"));
+    EXPECT_EQ(&a.get(), first);
+}
+
+TEST(connection_pool_test, keyed_config) {
+    Pool_config config;
+    config.max_size = 1;
+    Keyed_pool<Keyed_connection> pools(Pool_config(), [](void *storage, const std::string &key) {
+        return new(storage) Keyed_connection("redis://" + key);
+    });
+    pools.configure("small", config);
+    auto connection = pools.acquire("small");
+    EXPECT_EQ(connection->endpoint, "redis://small");
+    EXPECT_FALSE(pools.try_acquire("small", std::chrono::milliseconds(0)));
+    EXPECT_TRUE(pools.try_acquire("large", std::chrono::milliseconds(0)));
+}
+
+TEST(connection_pool_test, slab) {
+    Pool_config config;
+    config.slab_size = 2;
+    fake_pool pool(config);
+    auto destroyed = Fake_connection::destroyed.load();
+    Fake_connection *first = nullptr;
+    {
+        auto a = pool.acquire();
+        auto b = pool.acquire();
+        // slab is full, from the heap
+        auto c = pool.acquire();
+        EXPECT_EQ(&b.get(), &a.get() + 1);
+        EXPECT_NE(&c.get(), &a.get() + 2);
+        first = &a.get();
+        a->good = false;
+    }
+    EXPECT_EQ(Fake_connection::destroyed.load(), destroyed + 1);
+    // the discarded connection's slot is reused
+    auto d = pool.acquire();
+    auto e = pool.acquire();
+    auto f = pool.acquire();
+    EXPECT_EQ(&f.get(), first);
+}
+
+TEST(connection_pool_test, stats) {
+    Pool_config config;
+    config.collect_timing = true;
+    config.idle_capacity = 1;
+    fake_pool pool(config);
+    {
+        auto first = pool.acquire();
+        auto second = pool.acquire();
+        auto stats = pool.stats();
+        EXPECT_EQ(stats.busy, 2u);
+        EXPECT_EQ(stats.idle, 0u);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    // one kept, no room for the other
+    {
+        auto connection = pool.acquire();
+        connection->good = false;
+    }
+    auto stats = pool.stats();
+    EXPECT_EQ(stats.acquires, 3u);
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.creations, 2u);
+    EXPECT_EQ(stats.returns, 1u);
+    EXPECT_EQ(stats.discards, 2u);
+    EXPECT_EQ(stats.open, 0u);
+    EXPECT_EQ(stats.busy, 0u);
+    EXPECT_EQ(stats.acquire_latency.count, 3u);
+    EXPECT_EQ(stats.hold_time.count, 3u);
+    EXPECT_GE(stats.hold_time.percentile(0.9), std::chrono::milliseconds(2));
+    EXPECT_LT(stats.hold_time.percentile(0.9), std::chrono::seconds(1));
+}
+
+TEST(connection_pool_test, async_acquire) {
+    Pool_config config;
+    config.max_size = 1;
+    fake_pool pool(config);
+    std::optional<fake_pool::entry_type> held;
+    // right away
+    pool.async_acquire(std::chrono::milliseconds(100), [&held](auto entry) { held = std::move(entry); });
+    ASSERT_TRUE(held);
+
+    // has to wait, called when the held one comes back
+    Fake_connection *got = nullptr;
+    pool.async_acquire(std::chrono::milliseconds(100), [&got](auto entry) {
+        ASSERT_TRUE(entry);
+        got = &entry->get();
+    });
+    EXPECT_EQ(got, nullptr);
+    EXPECT_EQ(pool.wait_stats().waiting, 1u);
+    Fake_connection *first = &held->get();
+    held.reset();
+    EXPECT_EQ(got, first);
+    EXPECT_EQ(pool.wait_stats().waiting, 0u);
+}
+
+TEST(connection_pool_test, async_acquire_expires) {
+    Pool_config config;
+    config.max_size = 1;
+    fake_pool pool(config);
+    auto held = pool.acquire();
+    int32_t timed_out = 0;
+    pool.async_acquire(std::chrono::milliseconds(1), [&timed_out](auto entry) { timed_out += !entry; });
+    EXPECT_EQ(pool.expire_waiters(), 0u);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    EXPECT_EQ(pool.expire_waiters(), 1u);
+    EXPECT_EQ(timed_out, 1);
+    EXPECT_EQ(pool.wait_stats().timeouts, 1u);
+}
+
+TEST(connection_pool_test, async_acquire_threads) {
+    Pool_config config;
+    config.max_size = 2;
+    fake_pool pool(config);
+    const int32_t thread_count = 8;
+    const int32_t iterations = 1000;
+    std::atomic<int32_t> called{0};
+    std::atomic<int32_t> shared_use{0};
+    std::vector<std::thread> threads;
+    for (int32_t t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&] {
+            for (int32_t i = 0; i < iterations; ++i) {
+                // called here or on whichever thread gives a connection back
+                pool.async_acquire(std::chrono::seconds(30), [&](auto entry) {
+                    ASSERT_TRUE(entry);
+                    if (entry->get().in_use.exchange(true)) {
+                        ++shared_use;
+                    }
+                    entry->get().in_use.store(false);
+                    ++called;
+                });
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    EXPECT_EQ(called.load(), thread_count * iterations);
+    EXPECT_EQ(shared_use.load(), 0);
+    EXPECT_LE(pool.open(), 2u);
+}
+
+// just enough of a coroutine type to co_await in
+struct Task {
+    struct promise_type {
+        Task get_return_object() { return {}; }
+
+        std::suspend_never initial_suspend() noexcept { return {}; }
+
+        std::suspend_never final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+Task use_connection(fake_pool &pool, int32_t &done) {
+    auto entry = co_await pool.async_acquire(std::chrono::milliseconds(1000));
+    if (entry) {
+        ++entry->get().uses;
+        ++done;
+    }
+}
+
+TEST(connection_pool_test, co_await_acquire) {
+    Pool_config config;
+    config.max_size = 1;
+    fake_pool pool(config);
+    int32_t done = 0;
+    {
+        auto held = pool.acquire();
+        // all suspended, the one connection is taken
+        for (int32_t i = 0; i < 100; ++i) {
+            use_connection(pool, done);
+        }
+        EXPECT_EQ(done, 0);
+        EXPECT_EQ(pool.wait_stats().waiting, 100u);
+    }
+    // resumed one after the other as the connection comes back
+    EXPECT_EQ(done, 100);
+    EXPECT_EQ(pool.open(), 1u);
+    EXPECT_EQ(pool.acquire()->uses, 100);
+}
+
+Task use_connections(fake_pool &pool, int32_t count, std::atomic<int32_t> &done) {
+    for (int32_t i = 0; i < count; ++i) {
+        auto entry = co_await pool.async_acquire(std::chrono::seconds(30));
+        if (entry) {
+            ++entry->get().uses;
+        }
+        ++done;
+    }
+}
+
+// waits now and then, behind the other threads, otherwise done before it suspends
+TEST(connection_pool_test, co_await_loop) {
+    Pool_config config;
+    config.max_size = 1;
+    fake_pool pool(config);
+    pool.warm(1);
+    constexpr int32_t count = 5000;
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> others;
+    for (int32_t i = 0; i < 3; ++i) {
+        others.emplace_back([&pool, &stop] {
+            while (!stop) {
+                ++pool.acquire()->uses;
+            }
+        });
+    }
+    std::atomic<int32_t> done{0};
+    use_connections(pool, count, done);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (done < count && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    stop = true;
+    for (auto &thread: others) {
+        thread.join();
+    }
+    EXPECT_EQ(done.load(), count);
+    EXPECT_EQ(pool.open(), 1u);
+    EXPECT_GE(pool.acquire()->uses, count);
+}
+
+TEST(connection_pool_test, long_leases) {
+    Pool_config config;
+    config.tracked_leases = 2;
+    fake_pool pool(config);
+    auto held = pool.acquire("held");
+    EXPECT_TRUE(pool.long_leases(std::chrono::milliseconds(50)).empty());
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    {
+        auto brief = pool.acquire("brief");
+        // beyond tracked_leases, handed out but not recorded
+        auto untracked = pool.acquire();
+        auto leases = pool.long_leases(std::chrono::milliseconds(5));
+        ASSERT_EQ(leases.size(), 1u);
+        EXPECT_STREQ(leases[0].tag, "held");
+        EXPECT_EQ(leases[0].thread, std::this_thread::get_id());
+        EXPECT_GE(leases[0].held, std::chrono::milliseconds(5));
+        EXPECT_EQ(pool.long_leases(std::chrono::milliseconds(0)).size(), 2u);
+    }
+    EXPECT_EQ(pool.long_leases(std::chrono::milliseconds(0)).size(), 1u);
+    EXPECT_EQ(pool.stats().hold_time.count, 2u);
+}
+
+TEST(connection_pool_test, watch_leases) {
+    Pool_config config;
+    config.tracked_leases = 4;
+    fake_pool pool(config);
+    std::mutex mutex;
+    std::condition_variable reported;
+    std::string tag;
+    pool.watch_leases(std::chrono::milliseconds(1), std::chrono::milliseconds(1),
+                      [&](const std::vector<Lease_info> &leases) {
+                          std::lock_guard<std::mutex> lock(mutex);
+                          tag = leases.front().tag;
+                          reported.notify_one();
+                      });
+    std::thread slow([&pool] {
+        auto connection = pool.acquire("slow work");
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    });
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        EXPECT_TRUE(reported.wait_for(lock, std::chrono::seconds(5), [&tag] { return !tag.empty(); }));
+    }
+    // before what the report uses goes out of scope
+    pool.stop_watching();
+    slow.join();
+    EXPECT_EQ(tag, "slow work");
+}
+
+// the report stops the watch, or replaces it, from the watchdog's own thread
+TEST(connection_pool_test, watch_stopped_by_report) {
+    Pool_config config;
+    config.tracked_leases = 4;
+    fake_pool pool(config);
+    auto held = pool.acquire("held");
+    std::atomic<int32_t> first{0};
+    std::atomic<int32_t> second{0};
+    pool.watch_leases(std::chrono::milliseconds(1), std::chrono::milliseconds(1),
+                      [&](const std::vector<Lease_info> &) {
+                          if (++first == 1) {
+                              pool.watch_leases(std::chrono::milliseconds(1), std::chrono::milliseconds(1),
+                                                [&](const std::vector<Lease_info> &) {
+                                                    ++second;
+                                                    pool.stop_watching();
+                                                });
+                          }
+                      });
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (second == 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    // each gone after the call that stopped it
+    EXPECT_EQ(first.load(), 1);
+    EXPECT_EQ(second.load(), 1);
+    pool.stop_watching();
+}
+
+// the server is down while it says so
+struct Flaky_connection : Fake_connection {
+    static inline std::atomic<bool> server_down{false};
+    static inline std::atomic<int32_t> connects{0};
+    static inline std::atomic<int32_t> connect_ms{0};
+
+    Flaky_connection() {
+        ++connects;
+        std::this_thread::sleep_for(std::chrono::milliseconds(connect_ms.load()));
+        good = !server_down;
+    }
+};
+
+TEST(connection_pool_test, circuit_breaker) {
+    Pool_config config;
+    config.breaker_threshold = 3;
+    config.breaker_cooldown = std::chrono::milliseconds(30);
+    Pool<Flaky_connection> pool(config);
+    Flaky_connection::server_down = true;
+    Flaky_connection::connects = 0;
+    for (int32_t i = 0; i < 3; ++i) {
+        EXPECT_THROW(pool.acquire(), Pool_unavailable);
+    }
+    EXPECT_TRUE(pool.breaker_open());
+    // fails fast, no connect attempted
+    EXPECT_THROW(pool.acquire(), Pool_unavailable);
+    EXPECT_FALSE(pool.try_acquire(std::chrono::milliseconds(0)));
+    EXPECT_EQ(Flaky_connection::connects.load(), 3);
+    EXPECT_EQ(pool.open(), 0u);
+
+    // one try after the cooldown, still down
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    EXPECT_THROW(pool.acquire(), Pool_unavailable);
+    EXPECT_THROW(pool.acquire(), Pool_unavailable);
+    EXPECT_EQ(Flaky_connection::connects.load(), 4);
+
+    // back up, the next try closes the breaker
+    Flaky_connection::server_down = false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    EXPECT_NO_THROW(pool.acquire());
+    EXPECT_FALSE(pool.breaker_open());
+    EXPECT_NO_THROW(pool.acquire());
+}
+
+// a failed connect, not enough to open the breaker, doesn't make running out "unavailable"
+TEST(connection_pool_test, circuit_breaker_closed_timeout) {
+    Pool_config config;
+    config.max_size = 1;
+    config.acquire_timeout = std::chrono::milliseconds(10);
+    config.breaker_threshold = 3;
+    Pool<Flaky_connection> pool(config);
+    Flaky_connection::server_down = true;
+    EXPECT_THROW(pool.acquire(), Pool_unavailable);
+    EXPECT_FALSE(pool.breaker_open());
+    // the one slot is taken by a slow connect that hasn't reset the failure yet
+    Flaky_connection::server_down = false;
+    Flaky_connection::connect_ms = 100;
+    std::thread slow([&pool] { EXPECT_NO_THROW(pool.acquire()); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_THROW(pool.acquire(), Pool_timeout);
+    slow.join();
+    Flaky_connection::connect_ms = 0;
+}
+
+// wait up to a second for the pool to have idle connections
+template<class POOL>
+bool wait_for_idle(const POOL &pool, size_t idle) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (pool.idle() < idle && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return pool.idle() >= idle;
+}
+
+TEST(connection_pool_test, replenish) {
+    Pool_config config;
+    config.replenish_rate = 1000;
+    fake_pool pool(config);
+    {
+        auto first = pool.acquire();
+        auto second = pool.acquire();
+        first->good = false;
+    }
+    // the good one came back, the bad one is replaced in the background
+    EXPECT_TRUE(wait_for_idle(pool, 2));
+    EXPECT_EQ(pool.stats().replenished, 1u);
+    EXPECT_EQ(pool.open(), 2u);
+}
+
+TEST(connection_pool_test, replenish_rate) {
+    Pool_config config;
+    config.replenish_rate = 20;
+    fake_pool pool(config);
+    {
+        std::vector<fake_pool::entry_type> entries;
+        for (int32_t i = 0; i < 5; ++i) {
+            entries.push_back(pool.acquire());
+            entries.back()->good = false;
+        }
+    }
+    // one right away, then one per 50ms
+    std::this_thread::sleep_for(std::chrono::milliseconds(70));
+    EXPECT_LE(pool.stats().replenished, 2u);
+    EXPECT_TRUE(wait_for_idle(pool, 5));
+    EXPECT_EQ(pool.stats().replenished, 5u);
+}
+
+TEST(connection_pool_test, replenish_server_down) {
+    Pool_config config;
+    config.replenish_rate = 1000;
+    config.breaker_threshold = 2;
+    config.breaker_cooldown = std::chrono::milliseconds(20);
+    Flaky_connection::server_down = false;
+    Pool<Flaky_connection> pool(config);
+    {
+        auto connection = pool.acquire();
+        Flaky_connection::server_down = true;
+        connection->good = false;
+    }
+    // tries, fails, and waits for the breaker, then gets through once it's back up
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    EXPECT_EQ(pool.idle(), 0u);
+    EXPECT_TRUE(pool.breaker_open());
+    Flaky_connection::server_down = false;
+    EXPECT_TRUE(wait_for_idle(pool, 1));
+    EXPECT_EQ(pool.stats().replenished, 1u);
+}
+
+// run with -DUSE_SANITIZERS=ON -DUSE_THREAD_SANITIZER=ON to have tsan check this
+template<class POOL = fake_pool>
+void contention(const Pool_config &config) {
+    POOL pool(config);
+    const int32_t thread_count = 32;
+    const int32_t iterations = 2000;
+    std::atomic<int32_t> shared_use{0};
+
+    std::vector<std::thread> threads;
+    for (int32_t t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&pool, &shared_use] {
+            for (int32_t i = 0; i < iterations; ++i) {
+                auto connection = pool.acquire();
+                // nobody else may have this connection right now
+                if (connection->in_use.exchange(true)) {
+                    ++shared_use;
+                }
+                ++connection->uses;
+                connection->in_use.store(false);
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    EXPECT_EQ(shared_use.load(), 0);
+    if (config.max_size) {
+        EXPECT_LE(pool.open(), config.max_size);
+    }
+    EXPECT_LE(pool.idle(), static_cast<size_t>(thread_count) * (config.thread_cache_size + 1));
+    auto stats = pool.stats();
+    EXPECT_EQ(stats.acquires, static_cast<uint64_t>(thread_count * iterations));
+    EXPECT_EQ(stats.returns + stats.discards, stats.acquires);
+    EXPECT_EQ(stats.busy, 0u);
+}
+
+TEST(connection_pool_test, contention) {
+    contention(Pool_config());
+}
+
+TEST(connection_pool_test, contention_thread_cache) {
+    Pool_config config;
+    config.thread_cache_size = 4;
+    contention(config);
+}
+
+TEST(connection_pool_test, contention_bounded) {
+    Pool_config config;
+    config.max_size = 4;
+    config.acquire_timeout = std::chrono::seconds(30);
+    contention(config);
+}
+
+TEST(connection_pool_test, contention_aging) {
+    Pool_config config;
+    config.idle_ttl = std::chrono::milliseconds(1);
+    config.reap_interval = std::chrono::milliseconds(1);
+    contention(config);
+}
+
+TEST(connection_pool_test, contention_timing) {
+    Pool_config config;
+    config.collect_timing = true;
+    contention(config);
+}
+
+TEST(connection_pool_test, contention_leases) {
+    Pool_config config;
+    config.tracked_leases = 16;
+    contention(config);
+}
+
+TEST(connection_pool_test, contention_fifo) {
+    contention<Pool<Fake_connection, Fifo>>(Pool_config());
+}
+
+TEST(connection_pool_test, contention_least_used) {
+    Pool_config config;
+    config.thread_cache_size = 2;
+    contention<Pool<Fake_connection, Least_used>>(config);
+}
+
+TEST(connection_pool_test, contention_slab) {
+    Pool_config config;
+    config.slab_size = 8;
+    config.idle_capacity = 8;
+    contention(config);
+}
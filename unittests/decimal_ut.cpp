@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+#include <algorithm.h>
+#include <decimal.hpp>
+#include <cstdint>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <typeinfo>
+#include <vector>
+
+using om_tools::lex_cast;
+using om_tools::lex_format;
+using om_tools::utilities::Decimal;
+using om_tools::utilities::Money;
+
+namespace {
+
+// a binary numeric the way PG sends it, base 10000 digits
+std::string numeric(int16_t weight, uint16_t sign, std::vector<uint16_t> digits) {
+    std::string bytes;
+    auto put = [&](uint16_t value) {
+        bytes += static_cast<char>(value >> 8);
+        bytes += static_cast<char>(value & 0xff);
+    };
+    put(static_cast<uint16_t>(digits.size()));
+    put(static_cast<uint16_t>(weight));
+    put(sign);
+    put(0);
+    for (auto digit: digits) {
+        put(digit);
+    }
+    return bytes;
+}
+
+}
+
+TEST(decimal_test, text) {
+    EXPECT_EQ(lex_cast<Money>("1234.56").units(), 123456);
+    EXPECT_EQ(lex_cast<Money>("-0.05").units(), -5);
+    EXPECT_EQ(lex_cast<Money>("7").units(), 700);
+    EXPECT_EQ(lex_cast<Money>(".5").units(), 50);
+    EXPECT_EQ(lex_cast<Money>(" +12.5").units(), 1250);
+    // money output
+    EXPECT_EQ(lex_cast<Money>("$1,234.56").units(), 123456);
+    EXPECT_EQ(lex_cast<Money>("-$1,000,000.00").units(), -100000000);
+    EXPECT_EQ(lex_cast<Decimal<0>>("42").units(), 42);
+    EXPECT_EQ(lex_cast<Money>("92233720368547758.07").units(), INT64_MAX);
+    EXPECT_EQ(lex_cast<Money>("-92233720368547758.08").units(), INT64_MIN);
+}
+
+TEST(decimal_test, rounding) {
+    EXPECT_EQ(lex_cast<Money>("0.125").units(), 13);
+    EXPECT_EQ(lex_cast<Money>("0.12499999").units(), 12);
+    EXPECT_EQ(lex_cast<Money>("-0.125").units(), -13);
+    EXPECT_EQ(lex_cast<Decimal<0>>("2.5").units(), 3);
+    EXPECT_EQ(lex_cast<Money>("0.0000000000000000000000001").units(), 0);
+}
+
+TEST(decimal_test, text_errors) {
+    EXPECT_THROW(lex_cast<Money>(""), std::bad_cast);
+    EXPECT_THROW(lex_cast<Money>("NaN"), std::bad_cast);
+    EXPECT_THROW(lex_cast<Money>("-"), std::bad_cast);
+    EXPECT_THROW(lex_cast<Money>("92233720368547758.08"), std::bad_cast);
+    EXPECT_THROW(lex_cast<Money>("99999999999999999999"), std::bad_cast);
+    EXPECT_THROW(lex_cast<Money>("92233720368547758.075"), std::bad_cast);
+
+    // stops where the number does
+    Money value;
+    std::string_view text = "12.50 EUR";
+    auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    EXPECT_EQ(error, std::errc());
+    EXPECT_EQ(std::string_view(end), " EUR");
+    // a ',' is only money
+    text = "1,234";
+    auto comma = from_chars(text.data(), text.data() + text.size(), value);
+    EXPECT_EQ(value.units(), 100);
+    EXPECT_EQ(*comma.ptr, ',');
+}
+
+TEST(decimal_test, format) {
+    char buffer[om_tools::utilities::lex_format_size];
+    EXPECT_EQ(lex_format(buffer, Money::from_units(123456)), "1234.56");
+    EXPECT_EQ(lex_format(buffer, Money::from_units(-5)), "-0.05");
+    EXPECT_EQ(lex_format(buffer, Money(3)), "3.00");
+    EXPECT_EQ(lex_format(buffer, Decimal<0>(-42)), "-42");
+    EXPECT_EQ(lex_format(buffer, Money::from_units(INT64_MIN)), "-92233720368547758.08");
+    EXPECT_EQ(lex_format(buffer, Decimal<18>::from_units(INT64_MAX)), "9.223372036854775807");
+
+    std::string params;
+    om_tools::lex_format_to(params, Decimal<4>::from_units(10001));
+    EXPECT_EQ(params, "1.0001");
+
+    std::ostringstream os;
+    os << Money::from_units(1999);
+    EXPECT_EQ(os.str(), "19.99");
+
+    char small[4];
+    EXPECT_EQ(to_chars(small, small + sizeof small, Money(10)).ec, std::errc::value_too_large);
+}
+
+TEST(decimal_test, binary_numeric) {
+    // 1234.5678
+    EXPECT_EQ(Decimal<4>::from_pg_numeric(numeric(0, 0, {1234, 5678})).units(), 12345678);
+    // 12345678.9, rounded to cents
+    EXPECT_EQ(Money::from_pg_numeric(numeric(1, 0, {1234, 5678, 9000})).units(), 1234567890);
+    // -0.005, weight -1
+    EXPECT_EQ(Money::from_pg_numeric(numeric(-1, 0x4000, {50})).units(), -1);
+    // 0.00000001, weight -2
+    EXPECT_EQ(Decimal<8>::from_pg_numeric(numeric(-2, 0, {1})).units(), 1);
+    // 20000, trailing zero groups left out
+    EXPECT_EQ(Money::from_pg_numeric(numeric(1, 0, {2})).units(), 2000000);
+    EXPECT_EQ(Money::from_pg_numeric(numeric(0, 0, {})).units(), 0);
+
+    // NaN, too big, bad digit, short
+    EXPECT_THROW(Money::from_pg_numeric(numeric(0, 0xC000, {})), std::bad_cast);
+    EXPECT_THROW(Money::from_pg_numeric(numeric(5, 0, {1})), std::bad_cast);
+    EXPECT_THROW(Money::from_pg_numeric(numeric(0, 0, {10000})), std::bad_cast);
+    EXPECT_THROW(Money::from_pg_numeric(numeric(0, 0, {1}).substr(0, 9)), std::bad_cast);
+}
+
+TEST(decimal_test, binary_money) {
+    std::string bytes = {0, 0, 0, 0, 0, 0, 0x30, 0x39};
+    EXPECT_EQ(Money::from_pg_money(bytes).units(), 12345);
+    EXPECT_EQ(Decimal<4>::from_pg_money(bytes).units(), 1234500);
+    EXPECT_EQ(Decimal<0>::from_pg_money(bytes).units(), 123);
+    std::string minus_one(8, '\xff');
+    EXPECT_EQ(Money::from_pg_money(minus_one).units(), -1);
+    EXPECT_THROW(Money::from_pg_money("1234"), std::bad_cast);
+}
+
+TEST(decimal_test, arithmetic) {
+    Money total;
+    for (auto price: {"0.10", "0.20", "0.30"}) {
+        total += lex_cast<Money>(price);
+    }
+    EXPECT_EQ(total, lex_cast<Money>("0.60"));
+    EXPECT_EQ(total * 3, Money::from_units(180));
+    EXPECT_EQ(-total, Money::from_units(-60));
+    EXPECT_LT(total - Money(1), Money());
+    EXPECT_DOUBLE_EQ(total.to_double(), 0.6);
+    EXPECT_THROW(Money::from_units(INT64_MAX) + Money::from_units(1), std::overflow_error);
+    EXPECT_THROW(-Money::from_units(INT64_MIN), std::overflow_error);
+    EXPECT_THROW(Money(INT64_MAX / 10), std::overflow_error);
+}
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+#include <event_loop.hpp>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using om_tools::Event_loop;
+using om_tools::Socket;
+using namespace std::chrono_literals;
+
+namespace {
+
+// both ends of a connected unix socket
+std::pair<Socket, Socket> socket_pair() {
+    int fds[2];
+    EXPECT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    return {Socket(fds[0]), Socket(fds[1])};
+}
+
+// everything there is to read now
+std::string read_all(Socket &socket) {
+    std::string text;
+    char buffer[256];
+    ssize_t size;
+    while ((size = ::read(socket.get(), buffer, sizeof buffer)) > 0) {
+        text.append(buffer, static_cast<size_t>(size));
+    }
+    return text;
+}
+
+}
+
+TEST(event_loop_test, echo) {
+    Event_loop loop;
+    auto [server_end, client] = socket_pair();
+    loop.add(std::move(server_end), Event_loop::readable, [](Socket &socket, uint32_t) {
+        auto text = read_all(socket);
+        EXPECT_EQ(::write(socket.get(), text.data(), text.size()), static_cast<ssize_t>(text.size()));
+    });
+    EXPECT_EQ(loop.size(), 1u);
+
+    ASSERT_EQ(::write(client.get(), "ping", 4), 4);
+    EXPECT_EQ(loop.run_once(1s), 1u);
+    char buffer[8] = {};
+    EXPECT_EQ(::read(client.get(), buffer, sizeof buffer), 4);
+    EXPECT_STREQ(buffer, "ping");
+
+    // told once, nothing more to do
+    EXPECT_EQ(loop.run_once(10ms), 0u);
+}
+
+TEST(event_loop_test, hung_up) {
+    Event_loop loop;
+    auto [server_end, client] = socket_pair();
+    int handled = 0;
+    loop.add(std::move(server_end), Event_loop::readable, [&](Socket &socket, uint32_t events) {
+        ++handled;
+        read_all(socket);
+        if (events & Event_loop::hung_up) {
+            loop.remove(socket.get());
+            // still usable until the end of the turn
+            EXPECT_TRUE(socket.valid());
+        }
+    });
+    client.close();
+    client.set(Socket::invalid_socket);
+    EXPECT_EQ(loop.run_once(1s), 1u);
+    EXPECT_EQ(handled, 1);
+    EXPECT_EQ(loop.size(), 0u);
+}
+
+TEST(event_loop_test, release) {
+    Event_loop loop;
+    auto [server_end, client] = socket_pair();
+    int fd = loop.add(std::move(server_end), Event_loop::readable, [](Socket &, uint32_t) {
+        FAIL() << "released";
+    }).get();
+    Socket back = loop.release(fd);
+    EXPECT_EQ(back.get(), fd);
+    EXPECT_EQ(loop.size(), 0u);
+    ASSERT_EQ(::write(client.get(), "x", 1), 1);
+    EXPECT_EQ(loop.run_once(10ms), 0u);
+    EXPECT_FALSE(loop.release(fd).valid());
+}
+
+TEST(event_loop_test, accept_batches) {
+    const std::string name = "/tmp/event_loop_ut." + std::to_string(::getpid());
+    Event_loop loop;
+    std::vector<Socket> accepted;
+    loop.listen(Socket::create_uds_server_socket(name), [&](Socket client) {
+        EXPECT_TRUE(client.valid());
+        accepted.push_back(std::move(client));
+    }, 4);
+
+    std::vector<Socket> clients;
+    for (int i = 0; i < 10; ++i) {
+        clients.push_back(Socket::create_uds_client_socket(name));
+    }
+    loop.run_once(1s);
+    EXPECT_EQ(accepted.size(), 4u);
+    loop.run_once(1s);
+    EXPECT_EQ(accepted.size(), 8u);
+    loop.run_once(1s);
+    ASSERT_EQ(accepted.size(), 10u);
+    // non-blocking, nothing sent yet
+    char byte;
+    EXPECT_EQ(::read(accepted.front().get(), &byte, 1), -1);
+    EXPECT_EQ(errno, EAGAIN);
+    ::unlink(name.c_str());
+}
+
+TEST(event_loop_test, timers) {
+    Event_loop loop;
+    std::vector<std::string> ran;
+    loop.after(20ms, [&] { ran.emplace_back("late"); });
+    loop.after(0ms, [&] { ran.emplace_back("now"); });
+    auto cancelled = loop.after(0ms, [&] { ran.emplace_back("cancelled"); });
+    EXPECT_TRUE(loop.cancel(cancelled));
+    int ticks = 0;
+    Event_loop::Timer_id tick = 0;
+    tick = loop.every(5ms, [&] {
+        if (++ticks == 3) {
+            loop.cancel(tick);
+        }
+    });
+
+    auto start = Event_loop::clock::now();
+    while (Event_loop::clock::now() - start < 50ms) {
+        loop.run_once(50ms);
+    }
+    EXPECT_EQ(ran, (std::vector<std::string>{"now", "late"}));
+    EXPECT_EQ(ticks, 3);
+    EXPECT_FALSE(loop.cancel(tick));
+}
+
+TEST(event_loop_test, stop) {
+    Event_loop loop;
+    std::thread stopper([&loop] {
+        std::this_thread::sleep_for(20ms);
+        loop.stop();
+    });
+    // returns instead of waiting forever
+    loop.run();
+    stopper.join();
+}
@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <address_info.hpp>
+#include <resolver.hpp>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using om_tools::Addr_info;
+using om_tools::Resolver;
+using namespace std::chrono_literals;
+
+namespace {
+
+addrinfo tcp_hints() {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    return hints;
+}
+
+om_tools::Resolver_config quick(std::chrono::milliseconds ttl, std::chrono::milliseconds serve_stale) {
+    om_tools::Resolver_config config;
+    config.ttl = ttl;
+    config.serve_stale = serve_stale;
+    config.negative_ttl = 10s;
+    return config;
+}
+
+}
+
+TEST(resolver_test, cached) {
+    Resolver resolver;
+    auto first = resolver.resolve("localhost", "5432", tcp_hints());
+    ASSERT_TRUE(first);
+    EXPECT_EQ(first.error, 0);
+    auto second = resolver.resolve("localhost", "5432", tcp_hints());
+    // the same list, no lookup
+    EXPECT_EQ(second.addresses, first.addresses);
+    auto stats = resolver.stats();
+    EXPECT_EQ(stats.lookups, 1u);
+    EXPECT_EQ(stats.hits, 1u);
+
+    // a different port is a different name
+    EXPECT_TRUE(resolver.resolve("127.0.0.1", "6379", tcp_hints()));
+    EXPECT_EQ(resolver.size(), 2u);
+    resolver.clear();
+    EXPECT_EQ(resolver.size(), 0u);
+}
+
+TEST(resolver_test, negative) {
+    Resolver resolver(quick(30s, 0ms));
+    auto first = resolver.resolve("no.such.host.invalid", "80", tcp_hints());
+    EXPECT_FALSE(first);
+    EXPECT_NE(first.error, 0);
+    auto second = resolver.resolve("no.such.host.invalid", "80", tcp_hints());
+    EXPECT_FALSE(second);
+    auto stats = resolver.stats();
+    EXPECT_EQ(stats.lookups, 1u);
+    EXPECT_EQ(stats.failures, 1u);
+    EXPECT_EQ(stats.negative_hits, 1u);
+}
+
+TEST(resolver_test, stale_while_refreshing) {
+    Resolver resolver(quick(20ms, 10s));
+    auto first = resolver.resolve("localhost", "80", tcp_hints());
+    ASSERT_TRUE(first);
+    std::this_thread::sleep_for(30ms);
+
+    // expired, served at once while it is looked up again
+    auto stale = resolver.resolve("localhost", "80", tcp_hints());
+    EXPECT_EQ(stale.addresses, first.addresses);
+    EXPECT_EQ(resolver.stats().stale_hits, 1u);
+
+    auto start = std::chrono::steady_clock::now();
+    while (resolver.stats().lookups < 2 && std::chrono::steady_clock::now() - start < 5s) {
+        std::this_thread::sleep_for(1ms);
+    }
+    auto refreshed = resolver.resolve("localhost", "80", tcp_hints());
+    ASSERT_TRUE(refreshed);
+    EXPECT_NE(refreshed.addresses, first.addresses);
+    // the old list lives as long as someone holds it
+    EXPECT_NE(first.addresses->ai_addr, nullptr);
+}
+
+TEST(resolver_test, expired_past_stale) {
+    Resolver resolver(quick(10ms, 10ms));
+    auto first = resolver.resolve("localhost", "80", tcp_hints());
+    std::this_thread::sleep_for(30ms);
+    // waits for a new lookup
+    auto second = resolver.resolve("localhost", "80", tcp_hints());
+    ASSERT_TRUE(second);
+    EXPECT_NE(second.addresses, first.addresses);
+    EXPECT_EQ(resolver.stats().lookups, 2u);
+    EXPECT_EQ(resolver.stats().stale_hits, 0u);
+}
+
+TEST(resolver_test, one_lookup_for_many) {
+    Resolver resolver;
+    std::vector<std::thread> threads;
+    std::vector<om_tools::Resolution> results(8);
+    for (size_t i = 0; i < results.size(); ++i) {
+        threads.emplace_back([&, i] { results[i] = resolver.resolve("localhost", "443", tcp_hints()); });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    for (auto &result: results) {
+        EXPECT_EQ(result.addresses, results.front().addresses);
+    }
+    EXPECT_EQ(resolver.stats().lookups, 1u);
+
+    auto ready = resolver.resolve_async("localhost", "443", tcp_hints());
+    EXPECT_EQ(ready.wait_for(0s), std::future_status::ready);
+    EXPECT_EQ(ready.get().addresses, results.front().addresses);
+}
+
+TEST(resolver_test, addr_info) {
+    Addr_info tcp;
+    auto &addresses = tcp.getaddrinfo("localhost", "80");
+    ASSERT_TRUE(addresses);
+    EXPECT_EQ(addresses->ai_family, AF_INET);
+
+    // deleted, not freeaddrinfo()
+    Addr_info uds;
+    auto &unix_address = uds.getaddrinfo("a.sock", "");
+    ASSERT_TRUE(unix_address);
+    EXPECT_EQ(unix_address->ai_family, AF_UNIX);
+}
@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+#include <server.hpp>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using om_tools::Event_loop;
+using om_tools::Server;
+using om_tools::Socket;
+using namespace std::chrono_literals;
+
+namespace {
+
+// echo whatever comes in, until the client hangs up
+void echo(Event_loop &loop, Socket client) {
+    loop.add(std::move(client), Event_loop::readable, [&loop](Socket &socket, uint32_t events) {
+        char buffer[256];
+        ssize_t size;
+        while ((size = ::read(socket.get(), buffer, sizeof buffer)) > 0) {
+            EXPECT_EQ(::write(socket.get(), buffer, static_cast<size_t>(size)), size);
+        }
+        if (size == 0 || (events & Event_loop::hung_up)) {
+            loop.remove(socket.get());
+        }
+    });
+}
+
+// a round trip through the server
+bool ping(uint16_t port) {
+    auto client = Socket::create_tcp_client_socket("127.0.0.1", std::to_string(port));
+    char byte = 'x';
+    return client.valid() && ::write(client.get(), &byte, 1) == 1 && ::read(client.get(), &byte, 1) == 1 &&
+           byte == 'x';
+}
+
+// what the kernel makes of a steering program, for the few instructions it uses
+uint32_t run(const std::vector<sock_filter> &program, uint32_t cpu) {
+    uint32_t a = 0;
+    for (const sock_filter &op: program) {
+        switch (op.code) {
+            case BPF_LD | BPF_W | BPF_ABS:
+                a = cpu;
+                break;
+            case BPF_ALU | BPF_ADD | BPF_K:
+                a += op.k;
+                break;
+            case BPF_ALU | BPF_MOD | BPF_K:
+                a %= op.k;
+                break;
+            case BPF_RET | BPF_A:
+                return a;
+            default:
+                ADD_FAILURE() << "unexpected instruction " << op.code;
+                return 0;
+        }
+    }
+    return a;
+}
+
+}
+
+TEST(server_test, workers_share_the_port) {
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    std::atomic<int> accepted{0};
+    Server server;
+    server.port("0").workers(4).on_accept([&](Event_loop &loop, Socket client) {
+        {
+            std::lock_guard lock(mutex);
+            threads.insert(std::this_thread::get_id());
+        }
+        ++accepted;
+        echo(loop, std::move(client));
+    }).start();
+    ASSERT_NE(server.bound_port(), 0);
+    EXPECT_EQ(server.worker_count(), 4u);
+    EXPECT_FALSE(server.steering());
+
+    for (int i = 0; i < 64; ++i) {
+        ASSERT_TRUE(ping(server.bound_port()));
+    }
+    server.stop();
+    EXPECT_EQ(accepted, 64);
+    // spread by the kernel, by a hash of the client port, one worker for all 64 is next to impossible
+    EXPECT_GT(threads.size(), 1u);
+    EXPECT_EQ(server.worker_count(), 0u);
+}
+
+TEST(server_test, pinned_and_steered) {
+    size_t cpus = std::max(std::thread::hardware_concurrency(), 1u);
+    std::atomic<int> started{0};
+    Server server;
+    server.port("0").workers(cpus).steer_by_cpu()
+        .on_start([&](Event_loop &, size_t worker) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            ASSERT_EQ(::pthread_getaffinity_np(::pthread_self(), sizeof set, &set), 0);
+            EXPECT_TRUE(CPU_ISSET(worker % cpus, &set));
+            EXPECT_EQ(CPU_COUNT(&set), 1);
+            ++started;
+        })
+        .on_accept(echo)
+        .start();
+    EXPECT_TRUE(server.steering());
+    for (int i = 0; i < 16; ++i) {
+        ASSERT_TRUE(ping(server.bound_port()));
+    }
+    server.stop();
+    EXPECT_FALSE(server.steering());
+    EXPECT_EQ(started, static_cast<int>(cpus));
+}
+
+// a client goes to the worker pinned to the CPU it arrives on, whatever CPU the workers start at
+TEST(server_test, steering_matches_pinning) {
+    const size_t cpus = 8;
+    for (size_t workers: {1u, 3u, 8u, 12u}) {
+        for (size_t first_cpu: {0u, 2u, 5u, 7u, 10u}) {
+            auto program = Server::steering_program(first_cpu, workers, cpus);
+            for (uint32_t cpu = 0; cpu < cpus; ++cpu) {
+                size_t worker = run(program, cpu);
+                ASSERT_LT(worker, workers);
+                bool has_worker = false;
+                for (size_t i = 0; i < workers; ++i) {
+                    has_worker |= Server::cpu_of(i, first_cpu, cpus) == cpu;
+                }
+                if (has_worker) {
+                    EXPECT_EQ(Server::cpu_of(worker, first_cpu, cpus), cpu)
+                        << workers << " workers from CPU " << first_cpu;
+                }
+            }
+        }
+    }
+}
+
+TEST(server_test, errors) {
+    Server server;
+    EXPECT_THROW(server.start(), std::invalid_argument);
+    server.port("0").on_accept(echo);
+    server.start();
+    EXPECT_THROW(server.start(), std::logic_error);
+    // the port is taken, without SO_REUSEPORT
+    auto taken = Socket::create_tcp_server_socket(std::to_string(server.bound_port()));
+    EXPECT_FALSE(taken.valid());
+}
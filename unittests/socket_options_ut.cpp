@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+#include <server.hpp>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+using om_tools::Event_loop;
+using om_tools::Server;
+using om_tools::Socket;
+using om_tools::descriptors::Connect_options;
+using om_tools::descriptors::Keep_alive;
+using om_tools::descriptors::Socket_profile;
+using namespace std::chrono_literals;
+
+namespace {
+
+int option(const Socket &socket, int level, int name) {
+    int value = -1;
+    socklen_t length = sizeof value;
+    EXPECT_EQ(::getsockopt(socket.get(), level, name, &value, &length), 0);
+    return value;
+}
+
+uint16_t port_of(const Socket &socket) {
+    sockaddr_in address{};
+    socklen_t length = sizeof address;
+    ::getsockname(socket.get(), reinterpret_cast<sockaddr *>(&address), &length);
+    return ntohs(address.sin_port);
+}
+
+}
+
+TEST(socket_options_test, chained) {
+    Socket socket(::socket(AF_INET, SOCK_STREAM, 0));
+    socket.no_delay()
+        .receive_buffer(64 << 10)
+        .send_buffer(32 << 10)
+        .user_timeout(3s)
+        .keep_alive(Keep_alive{20s, 4s, 2});
+    EXPECT_EQ(option(socket, IPPROTO_TCP, TCP_NODELAY), 1);
+    // doubled by the kernel
+    EXPECT_EQ(option(socket, SOL_SOCKET, SO_RCVBUF), 128 << 10);
+    EXPECT_EQ(option(socket, SOL_SOCKET, SO_SNDBUF), 64 << 10);
+    EXPECT_EQ(option(socket, IPPROTO_TCP, TCP_USER_TIMEOUT), 3000);
+    EXPECT_EQ(option(socket, SOL_SOCKET, SO_KEEPALIVE), 1);
+    EXPECT_EQ(option(socket, IPPROTO_TCP, TCP_KEEPIDLE), 20);
+    EXPECT_EQ(option(socket, IPPROTO_TCP, TCP_KEEPINTVL), 4);
+    EXPECT_EQ(option(socket, IPPROTO_TCP, TCP_KEEPCNT), 2);
+    socket.no_delay(false);
+    EXPECT_EQ(option(socket, IPPROTO_TCP, TCP_NODELAY), 0);
+
+    // not a TCP socket
+    Socket unix_socket(::socket(AF_UNIX, SOCK_STREAM, 0));
+    EXPECT_THROW(unix_socket.no_delay(), std::system_error);
+}
+
+TEST(socket_options_test, profiles) {
+    Socket tcp(::socket(AF_INET, SOCK_STREAM, 0));
+    EXPECT_TRUE(tcp.apply(Socket_profile::bulk_transfer()));
+    EXPECT_EQ(option(tcp, IPPROTO_TCP, TCP_NODELAY), 0);
+    // capped at net.core.rmem_max, still more than the default
+    EXPECT_GT(option(tcp, SOL_SOCKET, SO_RCVBUF), 128 << 10);
+    EXPECT_EQ(option(tcp, SOL_SOCKET, SO_KEEPALIVE), 1);
+
+    // the TCP options are left out
+    Socket unix_socket(::socket(AF_UNIX, SOCK_STREAM, 0));
+    Socket_profile profile;
+    profile.no_delay = true;
+    profile.send_buffer = 16 << 10;
+    EXPECT_TRUE(unix_socket.apply(profile));
+    EXPECT_EQ(option(unix_socket, SOL_SOCKET, SO_SNDBUF), 32 << 10);
+
+    // nothing set, nothing done
+    EXPECT_TRUE(tcp.apply({}));
+}
+
+TEST(socket_options_test, at_creation) {
+    std::atomic<int> no_delay{-1};
+    Server server;
+    server.port("0").workers(2).profile(Socket_profile::low_latency_rpc())
+        .on_accept([&](Event_loop &, Socket client) {
+            // inherited from the listener
+            no_delay = option(client, IPPROTO_TCP, TCP_NODELAY);
+        })
+        .start();
+
+    Connect_options options;
+    options.profile = Socket_profile::low_latency_rpc();
+    auto connected = Socket::connect_tcp("127.0.0.1", std::to_string(server.bound_port()), options);
+    ASSERT_TRUE(connected);
+    EXPECT_EQ(option(connected.socket, IPPROTO_TCP, TCP_NODELAY), 1);
+    EXPECT_EQ(option(connected.socket, IPPROTO_TCP, TCP_USER_TIMEOUT), 10000);
+
+    auto start = std::chrono::steady_clock::now();
+    while (no_delay == -1 && std::chrono::steady_clock::now() - start < 1s) {
+        std::this_thread::sleep_for(1ms);
+    }
+    server.stop();
+    EXPECT_EQ(no_delay, 1);
+
+    auto listener = Socket::create_tcp_server_socket("0", false, Socket_profile::bulk_transfer());
+    ASSERT_TRUE(listener.valid());
+    EXPECT_NE(port_of(listener), 0);
+    EXPECT_EQ(option(listener, SOL_SOCKET, SO_KEEPALIVE), 1);
+}
@@ -2,8 +2,16 @@
 // Created by Ola Mattsson on 2022-08-08.
 //
 #pragma once
+#include <chrono>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <string>
 #include <string_view>
 #include <sstream>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
 
 #if defined BOOST_VERSION
 #include <boost/lexical_cast.hpp>
@@ -15,22 +23,55 @@ namespace utilities {
 inline namespace v1_0_0 {
 #endif
 
+// numbers std::from_chars can read, char types are read as a character like the stream does
+template<typename T>
+inline constexpr bool from_chars_type = (std::is_integral<T>::value && !std::is_same<T, char>::value &&
+                                         !std::is_same<T, signed char>::value && !std::is_same<T, unsigned char>::value &&
+                                         !std::is_same<T, wchar_t>::value && !std::is_same<T, char16_t>::value &&
+                                         !std::is_same<T, char32_t>::value)
+#if defined __cpp_lib_to_chars
+                                        || std::is_floating_point<T>::value
+#endif
+    ;
+
+// types with a from_chars(first, last, T &) found by argument dependent lookup, like Decimal
+template<typename T, typename = void>
+struct reads_chars : std::false_type {};
+
+template<typename T>
+struct reads_chars<T, std::void_t<decltype(from_chars(std::declval<const char *>(), std::declval<const char *>(),
+                                                      std::declval<T &>()))>> : std::true_type {};
+
+// and the to_chars(first, last, const T &) to write them
+template<typename T, typename = void>
+struct writes_chars : std::false_type {};
+
+template<typename T>
+struct writes_chars<T, std::void_t<decltype(to_chars(std::declval<char *>(), std::declval<char *>(),
+                                                     std::declval<const T &>()))>> : std::true_type {};
+
 /**
- * If boost is available, it's lexical_cast is very fast and capable., but if converting a string is all
- * else this does the trick but
- * is no where near as fast, BUT, it's safe! Throws std::bad_cast when necessary
+ * String to T, throws std::bad_cast when it can't be done.
  *
+ * Numbers are read with std::from_chars, no locale, no stream, no allocation. Like reading
+ * from a stream, leading white space and a '+' are skipped and reading stops at the first
+ * character that doesn't belong to the number, so
  * ".7" successfully converts to double 0.69999... (lots of nines)
  *      and throws std::bad_cast if int is requested
  * "0.7" successfully converts to int 0 and double 0.6999... (more nines)
  * "Ten" throws std::bad_cast if any numeric type is requested
+ * "40000" throws std::bad_cast if int16_t is requested, it doesn't fit
+ * bool is "0" or "1", or 't'/'f' with DB_BOOL_t_f defined. Types with their own
+ * from_chars(), like Decimal, are read the same way.
+ *
+ * Other types, with an operator>>, go through boost::lexical_cast if boost is available,
+ * or a std::stringstream.
  *
  * Usage:
  *  int i = lex_cast<int>("10");
  *
  * @tparam T expected type
- * @param row
- * @param col
+ * @param source the text
  * @return converted item
  */
 
@@ -39,8 +80,8 @@ static T lex_cast(std::string_view source) {
 
 #if defined DB_BOOL_t_f
     // boolean string from at least Postgres is 't'/'f', get rid of this if you dont need it
-    if (std::is_same<T, bool>::value) {
-        switch (source[0]) {
+    if constexpr (std::is_same<T, bool>::value) {
+        switch (source.empty() ? '\0' : source[0]) {
             case 't':
             case 'T':
             case '1':
@@ -53,22 +94,204 @@ static T lex_cast(std::string_view source) {
     }
 #endif
 
+    if constexpr (std::is_same<T, bool>::value || from_chars_type<T> || reads_chars<T>::value) {
+        const char *first = source.data();
+        const char *last = first + source.size();
+        while (first != last && (*first == ' ' || (*first >= '\t' && *first <= '\r'))) {
+            ++first;
+        }
+        // from_chars takes a '-' but not a '+'
+        if (last - first > 1 && *first == '+' && first[1] != '-' && first[1] != '+') {
+            ++first;
+        }
+        if constexpr (std::is_same<T, bool>::value) {
+            int value = 0;
+            auto [end, error] = std::from_chars(first, last, value);
+            if (error != std::errc() || (value != 0 && value != 1)) {
+                throw std::bad_cast();
+            }
+            return value == 1;
+        } else if constexpr (from_chars_type<T>) {
+            T value{};
+            auto [end, error] = std::from_chars(first, last, value);
+            if (error != std::errc()) {
+                throw std::bad_cast();
+            }
+            return value;
+        } else {
+            T value{};
+            auto [end, error] = from_chars(first, last, value);
+            if (error != std::errc()) {
+                throw std::bad_cast();
+            }
+            return value;
+        }
+    } else {
 #if defined BOOST_VERSION
-    return boost::lexical_cast<T>(string_value);
+        return boost::lexical_cast<T>(source);
 #else
-#if __cplusplus >= 201103L
-    T out{};
-#else
-    T out = T();
+        T out{};
+        std::stringstream ss;
+        ss << source;
+        ss >> out;
+        if (ss.fail() && std::is_arithmetic<T>::value) {
+            throw std::bad_cast();
+        }
+        return out;
 #endif
-    std::stringstream ss;
-    ss << source;
-    ss >> out;
-    if (ss.fail() && std::is_arithmetic<T>::value) {
-        throw std::bad_cast();
     }
+}
+
+// big enough for any number, bool or timestamp lex_format() writes
+constexpr size_t lex_format_size = 40;
+
+template<typename T>
+struct is_system_time : std::false_type {};
+
+template<typename DURATION>
+struct is_system_time<std::chrono::time_point<std::chrono::system_clock, DURATION>> : std::true_type {};
+
+// types lex_format() writes into a char buffer, the others are already text
+template<typename T>
+inline constexpr bool lex_formattable =
+    std::is_arithmetic<T>::value || is_system_time<T>::value || writes_chars<T>::value;
+
+// value zero padded to width digits, at out
+inline char *format_padded(char *out, uint32_t value, int width) noexcept {
+    for (int i = width - 1; i >= 0; --i) {
+        out[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+    return out + width;
+}
+
+// "2024-03-05 14:07:09.123456+00", UTC, as Postgres reads it, no fraction if it is 0
+template<typename DURATION>
+char *format_time(char *first, char *last, std::chrono::time_point<std::chrono::system_clock, DURATION> time) noexcept {
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+    int64_t seconds = micros / 1000000;
+    int64_t fraction = micros % 1000000;
+    if (fraction < 0) {
+        fraction += 1000000;
+        --seconds;
+    }
+    int64_t days = seconds / 86400;
+    int64_t second_of_day = seconds % 86400;
+    if (second_of_day < 0) {
+        second_of_day += 86400;
+        --days;
+    }
+    // days to a civil date, Howard Hinnant's days_from_civil backwards, no localtime_r or locks
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const auto day_of_era = static_cast<uint32_t>(days - era * 146097);
+    const uint32_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    const uint32_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    const uint32_t shifted_month = (5 * day_of_year + 2) / 153;
+    const uint32_t day = day_of_year - (153 * shifted_month + 2) / 5 + 1;
+    const uint32_t month = shifted_month < 10 ? shifted_month + 3 : shifted_month - 9;
+    const int64_t year = static_cast<int64_t>(year_of_era) + era * 400 + (month <= 2);
+
+    char *out = first;
+    if (year >= 0 && year <= 9999) {
+        out = format_padded(out, static_cast<uint32_t>(year), 4);
+    } else {
+        out = std::to_chars(out, last, year).ptr;
+    }
+    *out++ = '-';
+    out = format_padded(out, month, 2);
+    *out++ = '-';
+    out = format_padded(out, day, 2);
+    *out++ = ' ';
+    out = format_padded(out, static_cast<uint32_t>(second_of_day / 3600), 2);
+    *out++ = ':';
+    out = format_padded(out, static_cast<uint32_t>(second_of_day / 60 % 60), 2);
+    *out++ = ':';
+    out = format_padded(out, static_cast<uint32_t>(second_of_day % 60), 2);
+    if (fraction) {
+        *out++ = '.';
+        out = format_padded(out, static_cast<uint32_t>(fraction), 6);
+    }
+    *out++ = '+';
+    *out++ = '0';
+    *out++ = '0';
     return out;
-#endif
+}
+
+// the text of value in [first, last), which holds lex_format_size, returns the end of it
+template<typename T>
+char *format_chars(char *first, char *last, const T &value) noexcept {
+    if constexpr (std::is_same<T, bool>::value) {
+        // what lex_cast<bool> reads, and Postgres
+        *first = value ? '1' : '0';
+        return first + 1;
+    } else if constexpr (std::is_arithmetic<T>::value && !from_chars_type<T>) {
+        // char types are a character, like a stream writes them, or floating point without to_chars
+        if constexpr (std::is_floating_point<T>::value) {
+            int written = std::snprintf(first, static_cast<size_t>(last - first), "%.17g", static_cast<double>(value));
+            return first + written;
+        } else {
+            *first = static_cast<char>(value);
+            return first + 1;
+        }
+    } else if constexpr (std::is_arithmetic<T>::value) {
+        // floating point is the shortest text that lex_cast reads back to the same value
+        return std::to_chars(first, last, value).ptr;
+    } else if constexpr (writes_chars<T>::value) {
+        return to_chars(first, last, value).ptr;
+    } else {
+        return format_time(first, last, value);
+    }
+}
+
+/**
+ * Value to text, the counterpart of lex_cast. Numbers, bool and timestamps are written into
+ * the buffer with std::to_chars, no locale, no stream, no allocation. Strings, and anything
+ * else a std::string_view can be made of, are returned as they are.
+ *
+ * bool is "1" or "0", floating point the shortest text that reads back to the same value,
+ * a std::chrono::system_clock::time_point is UTC, "2024-03-05 14:07:09.123456+00".
+ * Types with their own to_chars(), like Decimal, write themselves.
+ *
+ * Usage:
+ *  char buffer[lex_format_size];
+ *  std::string_view text = lex_format(buffer, 786.87);  // "786.87"
+ *
+ * @param buffer at least lex_format_size, checked at compile time
+ * @return the text, in buffer or value, valid as long as they are
+ */
+template<typename T, size_t LEN>
+std::string_view lex_format(char (&buffer)[LEN], const T &value) noexcept {
+    if constexpr (lex_formattable<T>) {
+        static_assert(LEN >= lex_format_size, "lex_format needs a buffer of lex_format_size");
+        return std::string_view(buffer, static_cast<size_t>(format_chars(buffer, buffer + LEN, value) - buffer));
+    } else {
+        static_assert(std::is_convertible<const T &, std::string_view>::value,
+                      "lex_format writes numbers, bool and timestamps, use lex_format_to for other types");
+        return std::string_view(value);
+    }
+}
+
+/**
+ * Append value to out, like lex_format. For an arena of many values, reuse out and it
+ * stops allocating once it has grown to size. Other types with an operator<< go through a
+ * std::ostringstream, which does allocate.
+ * @return the length appended
+ */
+template<typename T>
+size_t lex_format_to(std::string &out, const T &value) {
+    size_t size = out.size();
+    if constexpr (lex_formattable<T>) {
+        char buffer[lex_format_size];
+        out += lex_format(buffer, value);
+    } else if constexpr (std::is_convertible<const T &, std::string_view>::value) {
+        out += std::string_view(value);
+    } else {
+        std::ostringstream os;
+        os << value;
+        out += os.str();
+    }
+    return out.size() - size;
 }
 
 // safely copying the string_view to a char ARRAY, the point being that this will
@@ -85,4 +308,6 @@ size_t copy_array(char (&dst)[LEN], std::string_view src) {
 #endif
 }
 using utilities::lex_cast;
+using utilities::lex_format;
+using utilities::lex_format_to;
 }
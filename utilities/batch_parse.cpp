@@ -0,0 +1,448 @@
+//
+// The digit kernels of batch_parse.hpp, compiled for SSE4.2 and AVX2 with target attributes
+// and picked at runtime, the rest of the library is built for the baseline CPU.
+//
+
+#include "batch_parse.hpp"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <limits>
+
+#if !defined __cpp_lib_to_chars
+#include <cerrno>
+#include <cstdlib>
+#include <string>
+#endif
+
+#if (defined __x86_64__ || defined __i386__) && (defined __GNUC__ || defined __clang__)
+#define OM_TOOLS_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace om_tools::utilities {
+#if __cplusplus >= 201103L
+inline namespace v1_0_0 {
+#endif
+
+namespace {
+
+// fields parsed per round, the slots of a round stay in L1
+constexpr size_t round_size = 64;
+
+// up to 16 characters, right aligned and padded with '0', two slots next to each other make an AVX2 load
+struct alignas(16) Slot {
+    char chars[16];
+};
+
+constexpr size_t slot_size = sizeof(Slot::chars);
+
+// what a kernel found in a slot
+struct Slot_value {
+    // the digits, without the decimal point
+    uint64_t value;
+    // number of digits after the decimal point, -1 if there is none
+    int8_t point;
+    // false if there is something other than digits and one decimal point
+    bool valid;
+};
+
+// what the scan found in a field
+struct Field {
+    enum Kind : uint8_t {
+        // the characters are in slots[slot], and the next one if there are more than 16
+        slots,
+        error,
+        // too much for the fast path, std::from_chars does it
+        from_chars
+    };
+    Kind kind{error};
+    bool negative{false};
+    bool two_slots{false};
+    uint32_t slot{0};
+};
+
+// 16 digits in one slot, a value of up to 19 digits fits a uint64_t
+constexpr size_t max_digits = 19;
+constexpr uint64_t ten_to_16 = 10000000000000000ull;
+
+// doubles up to this are exact, as are these powers of 10, one divide rounds right
+constexpr uint64_t max_exact_mantissa = uint64_t(1) << 53;
+constexpr double exact_powers_of_10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+// fixed size copies that overlap rather than one memcpy of count, no call and fewer branches
+void fill_slot(Slot &slot, const char *chars, size_t count) noexcept {
+    std::memset(slot.chars, '0', slot_size);
+    char *end = slot.chars + slot_size;
+    if (count >= 8) {
+        std::memcpy(end - count, chars, 8);
+        std::memcpy(end - 8, chars + count - 8, 8);
+    } else if (count >= 4) {
+        std::memcpy(end - count, chars, 4);
+        std::memcpy(end - 4, chars + count - 4, 4);
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            end[i - count] = chars[i];
+        }
+    }
+}
+
+// an optional sign and digits, the digits aren't checked until the kernel looks at them
+inline Field scan_integer(std::string_view text, Slot *slots, size_t &used) noexcept {
+    Field field;
+    const char *first = text.data();
+    const char *last = first + text.size();
+    if (first != last && (*first == '-' || *first == '+')) {
+        field.negative = *first++ == '-';
+    }
+    // leading zeros don't count towards max_digits
+    while (last - first > 1 && *first == '0') {
+        ++first;
+    }
+    auto count = static_cast<size_t>(last - first);
+    if (count == 0 || count > max_digits) {
+        return field;
+    }
+    field.kind = Field::slots;
+    field.slot = static_cast<uint32_t>(used);
+    if (count > slot_size) {
+        field.two_slots = true;
+        fill_slot(slots[used++], first, count - slot_size);
+        fill_slot(slots[used++], last - slot_size, slot_size);
+    } else {
+        fill_slot(slots[used++], first, count);
+    }
+    return field;
+}
+
+/**
+ * An optional sign and up to 16 digits and decimal point, the kernel finds the point.
+ * Anything longer, and an exponent, inf or nan, which the kernel finds invalid, go to
+ * from_chars.
+ */
+inline Field scan_double(std::string_view text, Slot *slots, size_t &used) noexcept {
+    Field field;
+    const char *first = text.data();
+    const char *last = first + text.size();
+    if (first != last && (*first == '-' || *first == '+')) {
+        field.negative = *first++ == '-';
+    }
+    auto count = static_cast<size_t>(last - first);
+    if (count == 0 || count > slot_size) {
+        field.kind = Field::from_chars;
+        return field;
+    }
+    // all point and no digits
+    if (count == 1 && *first == '.') {
+        return field;
+    }
+    field.kind = Field::slots;
+    field.slot = static_cast<uint32_t>(used);
+    fill_slot(slots[used++], first, count);
+    return field;
+}
+
+bool to_int64(const Field &field, const Slot_value *found, int64_t &value) noexcept {
+    if (field.kind != Field::slots) {
+        return false;
+    }
+    const Slot_value &low = found[field.slot + field.two_slots];
+    uint64_t magnitude = low.value;
+    bool valid = low.valid && low.point < 0;
+    if (field.two_slots) {
+        const Slot_value &high = found[field.slot];
+        magnitude += high.value * ten_to_16;
+        valid &= high.valid && high.point < 0;
+    }
+    if (!valid) {
+        return false;
+    }
+    auto max = static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+    if (field.negative) {
+        if (magnitude > max + 1) {
+            return false;
+        }
+        // -(max + 1) can't be negated as an int64_t
+        value = magnitude ? -static_cast<int64_t>(magnitude - 1) - 1 : 0;
+    } else {
+        if (magnitude > max) {
+            return false;
+        }
+        value = static_cast<int64_t>(magnitude);
+    }
+    return true;
+}
+
+bool chars_to_double(std::string_view text, double &value) noexcept {
+    const char *first = text.data();
+    const char *last = first + text.size();
+    // from_chars takes a '-' but not a '+'
+    if (last - first > 1 && *first == '+' && first[1] != '-') {
+        ++first;
+    }
+#if defined __cpp_lib_to_chars
+    auto [end, error] = std::from_chars(first, last, value);
+    return error == std::errc() && end == last;
+#else
+    // strtod skips white space, and reads hex
+    if (first == last || *first == ' ' || (*first >= '\t' && *first <= '\r') ||
+        (last - first > 1 && first[0] == '0' && (first[1] == 'x' || first[1] == 'X'))) {
+        return false;
+    }
+    std::string copy(first, last);
+    char *end = nullptr;
+    errno = 0;
+    value = std::strtod(copy.c_str(), &end);
+    return errno != ERANGE && end == copy.c_str() + copy.size();
+#endif
+}
+
+bool to_double(const Field &field, std::string_view text, const Slot_value *found, double &value) noexcept {
+    if (field.kind == Field::error) {
+        return false;
+    }
+    if (field.kind == Field::slots) {
+        const Slot_value &slot = found[field.slot];
+        if (slot.valid && slot.value <= max_exact_mantissa) {
+            value = static_cast<double>(slot.value);
+            if (slot.point > 0) {
+                value /= exact_powers_of_10[slot.point];
+            }
+            if (field.negative) {
+                value = -value;
+            }
+            return true;
+        }
+    }
+    return chars_to_double(text, value);
+}
+
+/**
+ * The kernels, the value and decimal point of each slot.
+ */
+typedef void (*digits_kernel)(const Slot *slots, size_t count, Slot_value *found);
+
+void digits_scalar(const Slot *slots, size_t count, Slot_value *found) {
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t value = 0;
+        int point = -1;
+        bool valid = true;
+        for (size_t j = 0; j < slot_size; ++j) {
+            char c = slots[i].chars[j];
+            if (c == '.' && point < 0) {
+                point = static_cast<int>(slot_size - 1 - j);
+                continue;
+            }
+            // anything that isn't '0' to '9' wraps around to more than 9
+            auto digit = static_cast<unsigned>(static_cast<unsigned char>(c)) - '0';
+            valid &= digit <= 9;
+            value = value * 10 + digit;
+        }
+        found[i] = Slot_value{value, static_cast<int8_t>(point), valid};
+    }
+}
+
+#if defined OM_TOOLS_X86_SIMD
+
+/**
+ * Shuffles that take out the decimal point at index i, the digits before it move one
+ * step right and a 0 comes in first. remove_point[16] leaves the digits as they are.
+ */
+struct alignas(16) Shuffle {
+    int8_t index[16];
+};
+
+constexpr std::array<Shuffle, 17> make_remove_point() {
+    std::array<Shuffle, 17> shuffles{};
+    for (int point = 0; point <= 16; ++point) {
+        for (int j = 0; j < 16; ++j) {
+            // the high bit makes pshufb write a 0
+            int index = point == 16 || j > point ? j : j == 0 ? -128 : j - 1;
+            shuffles[point].index[j] = static_cast<int8_t>(index);
+        }
+    }
+    return shuffles;
+}
+
+constexpr std::array<Shuffle, 17> remove_point = make_remove_point();
+
+// the slot without point in the two 32 bit lanes of the 8 high and the 8 low digits
+inline uint64_t combine(uint32_t high, uint32_t low) noexcept {
+    return static_cast<uint64_t>(high) * 100000000 + low;
+}
+
+/**
+ * 16 characters, subtract '0' from each, take out the point if there is one, then add
+ * neighbours, weighted, in ever wider lanes: pairs of digits in 16 bits, 4 in 32 bits,
+ * and after narrowing 8 in 32 bits. Lane 0 then has the 8 high digits and lane 1 the 8 low ones.
+ */
+__attribute__((target("sse4.2")))
+void digits_sse4_2(const Slot *slots, size_t count, Slot_value *found) {
+    const __m128i zeros = _mm_set1_epi8('0');
+    const __m128i points = _mm_set1_epi8('.');
+    const __m128i nines = _mm_set1_epi8(9);
+    const __m128i tens = _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1);
+    const __m128i hundreds = _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1);
+    const __m128i ten_thousands = _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1);
+    for (size_t i = 0; i < count; ++i) {
+        __m128i chars = _mm_load_si128(reinterpret_cast<const __m128i *>(slots[i].chars));
+        auto dots = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chars, points)));
+        unsigned point = dots ? static_cast<unsigned>(__builtin_ctz(dots)) : 16;
+        __m128i digits = _mm_shuffle_epi8(
+            _mm_sub_epi8(chars, zeros),
+            _mm_load_si128(reinterpret_cast<const __m128i *>(remove_point[point].index)));
+        // anything that isn't '0' to '9' wraps around to more than 9, unsigned, a second point too
+        bool valid = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(digits, nines), nines)) == 0xffff;
+        digits = _mm_maddubs_epi16(digits, tens);
+        digits = _mm_madd_epi16(digits, hundreds);
+        digits = _mm_packus_epi32(digits, digits);
+        digits = _mm_madd_epi16(digits, ten_thousands);
+        found[i] = Slot_value{combine(static_cast<uint32_t>(_mm_cvtsi128_si32(digits)),
+                                      static_cast<uint32_t>(_mm_extract_epi32(digits, 1))),
+                              static_cast<int8_t>(dots ? 15 - static_cast<int>(point) : -1), valid};
+    }
+}
+
+// the same, two slots at a time, every step stays within a 128 bit half
+__attribute__((target("avx2")))
+void digits_avx2(const Slot *slots, size_t count, Slot_value *found) {
+    const __m256i zeros = _mm256_set1_epi8('0');
+    const __m256i points = _mm256_set1_epi8('.');
+    const __m256i nines = _mm256_set1_epi8(9);
+    const __m256i tens = _mm256_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1,
+                                          10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1);
+    const __m256i hundreds = _mm256_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1, 100, 1, 100, 1, 100, 1, 100, 1);
+    const __m256i ten_thousands = _mm256_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1,
+                                                    10000, 1, 10000, 1, 10000, 1, 10000, 1);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        // slots[i] is on a 32 byte boundary, i is even and the array is aligned for it
+        __m256i chars = _mm256_load_si256(reinterpret_cast<const __m256i *>(slots[i].chars));
+        auto dots = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, points)));
+        uint32_t low_dots = dots & 0xffff;
+        uint32_t high_dots = dots >> 16;
+        unsigned low_point = low_dots ? static_cast<unsigned>(__builtin_ctz(low_dots)) : 16;
+        unsigned high_point = high_dots ? static_cast<unsigned>(__builtin_ctz(high_dots)) : 16;
+        __m256i shuffle = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(remove_point[low_point].index))),
+            _mm_load_si128(reinterpret_cast<const __m128i *>(remove_point[high_point].index)), 1);
+        __m256i digits = _mm256_shuffle_epi8(_mm256_sub_epi8(chars, zeros), shuffle);
+        auto mask = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(digits, nines), nines)));
+        digits = _mm256_maddubs_epi16(digits, tens);
+        digits = _mm256_madd_epi16(digits, hundreds);
+        digits = _mm256_packus_epi32(digits, digits);
+        digits = _mm256_madd_epi16(digits, ten_thousands);
+        __m128i low = _mm256_castsi256_si128(digits);
+        __m128i high = _mm256_extracti128_si256(digits, 1);
+        found[i] = Slot_value{combine(static_cast<uint32_t>(_mm_cvtsi128_si32(low)),
+                                      static_cast<uint32_t>(_mm_extract_epi32(low, 1))),
+                              static_cast<int8_t>(low_dots ? 15 - static_cast<int>(low_point) : -1),
+                              (mask & 0xffff) == 0xffff};
+        found[i + 1] = Slot_value{combine(static_cast<uint32_t>(_mm_cvtsi128_si32(high)),
+                                          static_cast<uint32_t>(_mm_extract_epi32(high, 1))),
+                                  static_cast<int8_t>(high_dots ? 15 - static_cast<int>(high_point) : -1),
+                                  (mask >> 16) == 0xffff};
+    }
+    if (i < count) {
+        digits_sse4_2(slots + i, count - i, found + i);
+    }
+}
+
+#endif
+
+digits_kernel kernel_for(Simd simd) noexcept {
+#if defined OM_TOOLS_X86_SIMD
+    switch (std::min(simd, best_simd())) {
+        case Simd::avx2:
+            return digits_avx2;
+        case Simd::sse4_2:
+            return digits_sse4_2;
+        case Simd::scalar:
+            break;
+    }
+#else
+    (void) simd;
+#endif
+    return digits_scalar;
+}
+
+/**
+ * Scan a round of fields into slots, run the kernel over all the slots at once, then make
+ * the values from what it found.
+ * @param scan fills the slots of a field and says what it found
+ * @param convert the value of a field, false if the field is an error
+ */
+template<class T, class SCAN, class CONVERT>
+Parsed_column<T> parse(const std::string_view *fields, size_t count, Simd simd, SCAN scan, CONVERT convert) {
+    Parsed_column<T> column;
+    column.values.resize(count);
+    digits_kernel kernel = kernel_for(simd);
+    alignas(32) Slot slots[2 * round_size];
+    Slot_value found[2 * round_size];
+    Field scanned[round_size];
+    for (size_t first = 0; first < count; first += round_size) {
+        size_t round = std::min(round_size, count - first);
+        size_t used = 0;
+        for (size_t i = 0; i < round; ++i) {
+            scanned[i] = scan(fields[first + i], slots, used);
+        }
+        kernel(slots, used, found);
+        for (size_t i = 0; i < round; ++i) {
+            T value{};
+            if (!convert(scanned[i], fields[first + i], found, value)) {
+                column.errors.push_back(first + i);
+                value = T{};
+            }
+            column.values[first + i] = value;
+        }
+    }
+    return column;
+}
+
+}
+
+Simd best_simd() noexcept {
+#if defined OM_TOOLS_X86_SIMD
+    static const Simd best = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return Simd::avx2;
+        }
+        if (__builtin_cpu_supports("sse4.2")) {
+            return Simd::sse4_2;
+        }
+        return Simd::scalar;
+    }();
+    return best;
+#else
+    return Simd::scalar;
+#endif
+}
+
+// lambdas rather than function pointers, so they are inlined into the loops
+Parsed_column<int64_t> parse_int64(const std::string_view *fields, size_t count, Simd simd) {
+    return parse<int64_t>(
+        fields, count, simd,
+        [](std::string_view text, Slot *slots, size_t &used) { return scan_integer(text, slots, used); },
+        [](const Field &field, std::string_view, const Slot_value *found, int64_t &value) {
+            return to_int64(field, found, value);
+        });
+}
+
+Parsed_column<double> parse_double(const std::string_view *fields, size_t count, Simd simd) {
+    return parse<double>(
+        fields, count, simd,
+        [](std::string_view text, Slot *slots, size_t &used) { return scan_double(text, slots, used); },
+        [](const Field &field, std::string_view text, const Slot_value *found, double &value) {
+            return to_double(field, text, found, value);
+        });
+}
+
+#if __cplusplus >= 201103L
+}
+#endif
+}
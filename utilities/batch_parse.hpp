@@ -0,0 +1,87 @@
+#pragma once
+
+/**
+ * Parse a column of numbers at once, like a PG result column or an MGET reply.
+ *
+ * lex_cast converts one value at a time, this converts them all and puts the numbers
+ * next to each other in a vector. The characters of each field are copied into 16 byte
+ * slots, a round of fields at a time, then the slots are checked and summed 16 digits at
+ * a time with SSE4.2, or two slots at a time with AVX2, whichever the CPU has, picked at
+ * runtime. Other CPUs and compilers get a plain loop, same results.
+ *
+ * A field is a whole number, an optional sign and digits, nothing before or after, not
+ * even white space. Unlike lex_cast "42 rows" is an error. Doubles also take a decimal
+ * point, an exponent, "-1.5e3", and "inf" and "nan" like std::from_chars. The fast path is
+ * up to 16 digits and point, like a PG float8 or numeric in text, exactly rounded. Longer
+ * ones and exponents are handed to std::from_chars, just as exact but slower.
+ *
+ * A field that isn't a number, or doesn't fit, is 0 in the values and its index is in
+ * errors, the other fields are parsed anyway.
+ *
+ * Usage:
+ *  std::vector<std::string_view> fields = ...;
+ *  auto column = parse_int64(fields.data(), fields.size());
+ *  if (!column.ok()) {
+ *      std::cerr << "row " << column.errors.front() << " isn't a number\n";
+ *  }
+ *  auto sum = std::accumulate(column.values.begin(), column.values.end(), int64_t(0));
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#if __has_include(<span>)
+#include <span>
+#endif
+
+namespace om_tools::utilities {
+#if __cplusplus >= 201103L
+inline namespace v1_0_0 {
+#endif
+
+// the instructions a parse may use, best_simd() is what this CPU has
+enum class Simd {
+    scalar,
+    sse4_2,
+    avx2
+};
+
+// what the parse functions use by default, checked once
+Simd best_simd() noexcept;
+
+template<class T>
+struct Parsed_column {
+    // one per field, 0 for the ones in errors
+    std::vector<T> values;
+    // index of each field that isn't a number or doesn't fit, in order
+    std::vector<size_t> errors;
+
+    [[nodiscard]]
+    bool ok() const noexcept { return errors.empty(); }
+};
+
+/**
+ * @param fields the text of each field
+ * @param count number of fields
+ * @param simd to compare or rule out an instruction set, more than best_simd() is not used
+ */
+Parsed_column<int64_t> parse_int64(const std::string_view *fields, size_t count, Simd simd = best_simd());
+
+Parsed_column<double> parse_double(const std::string_view *fields, size_t count, Simd simd = best_simd());
+
+#if defined __cpp_lib_span
+inline Parsed_column<int64_t> parse_int64(std::span<const std::string_view> fields, Simd simd = best_simd()) {
+    return parse_int64(fields.data(), fields.size(), simd);
+}
+
+inline Parsed_column<double> parse_double(std::span<const std::string_view> fields, Simd simd = best_simd()) {
+    return parse_double(fields.data(), fields.size(), simd);
+}
+#endif
+
+#if __cplusplus >= 201103L
+}
+#endif
+}
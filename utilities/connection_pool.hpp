@@ -10,7 +10,9 @@
  *
  * The pooled connection class must implement `bool your_class::good_connection() const` and
  * 'void reset()', this way this pool can choose not to save a bad connection and to
- * supply an instance without any old response
+ * supply an instance without any old response.
+ * Optionally `bool test_connection()`, a liveness probe that may talk to the server, see
+ * Pool_config::validate_after.
  *
  * Note: don't hang on to the pointer returned by get(), if the
  * Pool_entry object goes out of scope, you have a dangling pointer and
@@ -25,42 +27,208 @@
  * // or with get()
  * connection.get().some_method();
  *
- * To use only this header, define the pools list with
+ * Thread safety
+ * get_entry() and the Pool_entry destructor can be called from any number of threads.
+ * The idle connections are kept in a lock-free stack, taking and giving back a
+ * connection is O(1) and never blocks. The stack is bounded, if it is full when
+ * a connection comes back, the connection is closed rather than hoarded.
  *
- * template<class CONNECTION>
- * std::vector<CONNECTION*> Pool<CONNECTION>::g_pool;
+ * Ordering
+ * By default the most recently returned connection is handed out first (Lifo), a few
+ * connections stay hot with warm socket buffers and server side caches, and the ones
+ * not needed go cold and age out, see Aging. Pool<Type, Fifo> hands out the least
+ * recently returned instead, every connection gets its turn, and Pool<Type, Least_used>
+ * the one handed out the fewest times. Both keep the idle connections under a mutex.
+ * The per thread cache is always most recent first.
  *
- * Improvement opportunities:
- * 1. aging, drop unused connections after a period like an hour
- * 2.
+ * Per thread cache
+ * Set Pool_config::thread_cache_size to let each thread keep a few idle connections
+ * for itself, the shared stack is only touched when the thread's cache is empty on
+ * acquire or full on release. A thread that repeatedly borrows then never contends
+ * with other threads. The cached connections go back to the pool when the thread exits.
+ *
+ * Bounded pool
+ * Set Pool_config::max_size to limit the number of open connections, idle and in use.
+ * When all are in use, acquire() waits in a FIFO queue for one to come back, and throws
+ * Pool_timeout after Pool_config::acquire_timeout. try_acquire(timeout) returns an
+ * empty optional instead. wait_stats() tells how often and how long callers waited,
+ * size the pool from that. Connections kept in thread caches are not available to
+ * waiters on other threads, keep thread_cache_size small on a bounded pool.
+ *
+ * Aging
+ * Set Pool_config::idle_ttl to close connections that have been idle longer than that,
+ * min_idle are kept regardless. Every reap_interval, an acquire() sweeps the idle
+ * connections, or call reap() from a timer of your own if the pool may go quiet.
+ * The sweep takes all idle connections off the stack for a moment, an acquire() at
+ * that very moment may open a new connection. Connections kept in thread caches are
+ * in active use and are not aged.
+ *
+ * Pre-warming
+ * Connections are created lazily, one at a time, the first requests after a start pay
+ * for connecting. Call warm(n) before the service reports ready, it opens n connections
+ * on a few threads at once and reports how long each took to connect.
+ *
+ * Validate on borrow
+ * A connection idle in the pool may have been closed by the server. Set
+ * Pool_config::validate_after and connections idle longer than that are probed with
+ * test_connection(), or good_connection() if the type has none, before they are handed
+ * out. A broken one is closed and the next idle, or a new, connection is used instead.
+ * Connections used more recently than that are handed out without a round-trip.
+ *
+ * Keyed pools
+ * Pool<Type> is one pool per type. To pool connections to more than one server or database,
+ * use a Keyed_pool, one Pool per key, like a connection string or "host:port". The key is
+ * passed to the connection constructor, or to a factory of your own. Each key can have its
+ * own Pool_config, for example a max_size per tenant.
+ *
+ * Keyed_pool<PGConnection> pools;
+ * auto connection = pools.acquire("host=localhost dbname=tenant_1");
+ *
+ * Storage
+ * The pool owns the memory of the connection objects, a factory constructs the connection
+ * in the storage it is given, `[](void *storage) { return new (storage) Type(...); }`.
+ * Set Pool_config::slab_size and the storage is a contiguous slab of that many objects
+ * with a free list, slots are recycled when connections come and go, no allocator calls.
+ * When the slab is full, storage comes from the heap.
+ *
+ * Circuit breaker
+ * When the server is down every acquire() would try to connect, and wait for the connect
+ * to fail. Set Pool_config::breaker_threshold and after that many consecutive failed
+ * connects, acquire() throws Pool_unavailable right away, try_acquire() returns empty,
+ * for breaker_cooldown. Then one caller gets to try, if that connect works the breaker
+ * closes, if not it stays open for another cooldown. Idle connections are still handed
+ * out while the breaker is open.
+ *
+ * Instrumentation
+ * stats() returns what the pool has done so far, acquires served from idle connections
+ * (hits) and by new ones, connections returned and closed, how many are in use right
+ * now, and, with Pool_config::collect_timing, how long acquire took and how long the
+ * connections were held. The counters are striped per thread and read without locks,
+ * cheap enough to leave on in production, graph them and size the pool from that.
+ *
+ * Lease tracking
+ * A thread that holds a connection across slow work starves the others. Set
+ * Pool_config::tracked_leases and the pool records when each connection was handed out,
+ * to which thread and the tag passed to get_entry(tag), like a function name. long_leases()
+ * lists the ones held longer than a threshold, watch_leases() does it on a thread of its
+ * own every so often and reports them to a callback. The record is a slot in a fixed table,
+ * taken and given back lock-free, a few stores per acquire. The hold time histogram in
+ * stats() is kept too.
+ *
+ * Asynchronous acquire
+ * An event loop can't block in acquire() when max_size is reached. async_acquire(timeout,
+ * callback) calls back right away when a connection is at hand, or waits in line with the
+ * blocking callers and is called on the thread that gives a connection back. In C++20,
+ * `auto entry = co_await pool.async_acquire(timeout);` suspends the coroutine instead.
+ * Nothing in the pool runs timers, call expire_waiters() from the loop's timer to time
+ * out the waiting ones.
+ *
+ * Replenishing
+ * A connection that comes back bad, or fails validation, is closed and the next acquire()
+ * pays for a new one. After a blip on the server that is every caller for a while. Set
+ * Pool_config::replenish_rate and a thread of the pool's own opens a replacement for each
+ * one closed, at most that many a second so a server coming back up isn't stampeded, and
+ * puts it with the idle connections. It stays within max_size and respects the circuit
+ * breaker, a failed replacement is tried again at the same rate. Connections aged out by
+ * idle_ttl are not replaced, that is the point of aging.
 */
 
+#include "lock_free.hpp"
+#include "slab.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define OM_TOOLS_POOL_COROUTINES
+#endif
+
 namespace om_tools::connection_pool {
 #if __cplusplus >= 201103L
 inline namespace v1_0_0 {
 #endif
 
+// what the pool needs back with a connection handed out, kept in the Pool_entry
+struct Lease {
+    // only set if the pool collects timing or tracks leases
+    std::chrono::steady_clock::time_point acquired{};
+    uint32_t uses{1};
+    // the pool's record of it, nil if not tracked
+    uint32_t slot{lock_free::Index_stack::nil};
+};
+
 template<class POOLED, class POOL>
 class Pool_entry {
     POOLED *m_pooled;
+    POOL *m_pool;
+    Lease m_lease;
 public:
 
-    Pool_entry() : m_pooled(new POOLED) {}
-
-    explicit Pool_entry(POOLED *pooled) : m_pooled(pooled) {}
+    Pool_entry(POOLED *pooled, POOL *pool, const Lease &lease = Lease())
+        : m_pooled(pooled), m_pool(pool), m_lease(lease) {}
 
     Pool_entry(const Pool_entry &) = delete;
 
+    // can be moved, the source will not return anything to the pool
+    Pool_entry(Pool_entry &&other) noexcept
+        : m_pooled(other.m_pooled), m_pool(other.m_pool), m_lease(other.m_lease) {
+        other.m_pooled = nullptr;
+    }
+
+    Pool_entry &operator=(const Pool_entry &) = delete;
+
+    // gives back what this one had, takes over the other
+    Pool_entry &operator=(Pool_entry &&other) noexcept {
+        if (this != &other) {
+            if (m_pooled) {
+                m_pool->return_entry(m_pooled, m_lease);
+            }
+            m_pooled = other.m_pooled;
+            m_pool = other.m_pool;
+            m_lease = other.m_lease;
+            other.m_pooled = nullptr;
+        }
+        return *this;
+    }
+
     ~Pool_entry() {
-        if (m_pooled->good_connection()) {
-            m_pooled->reset();
-            POOL::return_entry(m_pooled);
-        } else {
-            delete m_pooled;
+        if (m_pooled) {
+            m_pool->return_entry(m_pooled, m_lease);
         }
     }
 
+    // when the connection was handed out, only set if the pool collects timing or tracks leases
+    [[nodiscard]]
+    std::chrono::steady_clock::time_point acquired() const noexcept {
+        return m_lease.acquired;
+    }
+
+    // number of times the connection has been handed out, this one included
+    [[nodiscard]]
+    uint32_t uses() const noexcept {
+        return m_lease.uses;
+    }
+
+    [[nodiscard]]
+    const Lease &lease() const noexcept {
+        return m_lease;
+    }
+
     POOLED *operator->() const {
         return m_pooled;
     }
@@ -71,41 +239,1418 @@ public:
 };
 
 /**
+ * Idle connections in the order they came back, a ring under a mutex. Not lock-free
+ * like the stack, the order is the point. Same push, pop, size and capacity as
+ * lock_free::Bounded_stack.
+ */
+template<class T>
+class Idle_queue {
+    mutable std::mutex m_mutex;
+    std::vector<T> m_values;
+    size_t m_front{0};
+    size_t m_size{0};
+
+public:
+    explicit Idle_queue(size_t capacity) : m_values(capacity) {}
+
+    bool push(const T &value) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_size == m_values.size()) {
+            return false;
+        }
+        m_values[(m_front + m_size++) % m_values.size()] = value;
+        return true;
+    }
+
+    // the one that came back first
+    bool pop(T &value) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_size == 0) {
+            return false;
+        }
+        value = m_values[m_front];
+        m_front = (m_front + 1) % m_values.size();
+        --m_size;
+        return true;
+    }
+
+    [[nodiscard]]
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_size;
+    }
+
+    [[nodiscard]]
+    size_t capacity() const noexcept { return m_values.size(); }
+};
+
+/**
+ * Idle connections with the least used on top, a heap under a mutex, T needs a
+ * uses member. Same push, pop, size and capacity as lock_free::Bounded_stack.
+ */
+template<class T>
+class Idle_heap {
+    mutable std::mutex m_mutex;
+    std::vector<T> m_values;
+    const size_t m_capacity;
+
+    static bool more_used(const T &left, const T &right) noexcept {
+        return left.uses > right.uses;
+    }
+
+public:
+    explicit Idle_heap(size_t capacity) : m_capacity(capacity) {
+        m_values.reserve(capacity);
+    }
+
+    bool push(const T &value) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_values.size() == m_capacity) {
+            return false;
+        }
+        m_values.push_back(value);
+        std::push_heap(m_values.begin(), m_values.end(), more_used);
+        return true;
+    }
+
+    // the least used
+    bool pop(T &value) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_values.empty()) {
+            return false;
+        }
+        std::pop_heap(m_values.begin(), m_values.end(), more_used);
+        value = m_values.back();
+        m_values.pop_back();
+        return true;
+    }
+
+    [[nodiscard]]
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_values.size();
+    }
+
+    [[nodiscard]]
+    size_t capacity() const noexcept { return m_capacity; }
+};
+
+/**
+ * The order idle connections are handed out in, the ORDER parameter of Pool.
+ * idle_list<T> is the container, push, pop, size and capacity like the lock_free::Bounded_stack.
+ */
+
+// most recently returned first, a few hot connections do the work and the others age out
+struct Lifo {
+    template<class T>
+    using idle_list = lock_free::Bounded_stack<T>;
+};
+
+// least recently returned first, every connection gets its turn
+struct Fifo {
+    template<class T>
+    using idle_list = Idle_queue<T>;
+};
+
+// the one handed out the fewest times first, the work is spread evenly by count
+struct Least_used {
+    template<class T>
+    using idle_list = Idle_heap<T>;
+};
+
+struct Pool_config {
+    // max number of idle connections in the shared stack
+    size_t idle_capacity = 1024;
+    // idle connections each thread keeps for itself, 0 disables the per thread cache
+    size_t thread_cache_size = 0;
+    // max number of open connections, idle and in use, 0 is unlimited
+    size_t max_size = 0;
+    // how long acquire() waits for a connection when max_size is reached
+    std::chrono::milliseconds acquire_timeout{5000};
+    // idle connections unused for longer than this are closed, 0 keeps them forever
+    std::chrono::milliseconds idle_ttl{0};
+    // number of idle connections kept regardless of idle_ttl
+    size_t min_idle = 0;
+    // how often acquire() sweeps for connections idle longer than idle_ttl
+    std::chrono::milliseconds reap_interval{30000};
+    // connections idle longer than this are tested before handed out, 0 never tests
+    std::chrono::milliseconds validate_after{0};
+    // connection objects kept in a slab owned by the pool, 0 allocates each from the heap
+    size_t slab_size = 0;
+    // consecutive failed connects that open the circuit breaker, 0 disables it
+    uint32_t breaker_threshold = 0;
+    // how long an open breaker fails acquire() before letting one connect through
+    std::chrono::milliseconds breaker_cooldown{5000};
+    // measure acquire latency and hold time, two clock reads per acquire
+    bool collect_timing = false;
+    // leases recorded for long_leases() at a time, 0 disables, more at once go unrecorded
+    size_t tracked_leases = 0;
+    // replacements opened a second at most for connections closed because they were bad, 0 replaces none
+    size_t replenish_rate = 0;
+};
+
+// does the pooled type have a liveness probe, bool test_connection()
+template<class T, class = void>
+struct has_test_connection : std::false_type {};
+
+template<class T>
+struct has_test_connection<T, std::void_t<decltype(std::declval<T &>().test_connection())>>
+    : std::true_type {};
+
+// thrown by acquire() when no connection became available in time
+class Pool_timeout : public std::runtime_error {
+public:
+    explicit Pool_timeout(const char *msg) : std::runtime_error(msg) {}
+};
+
+// one connection opened by Pool::warm()
+struct Warm_result {
+    std::chrono::nanoseconds latency{0};
+    // false if the connection failed, or the constructor threw
+    bool good{false};
+};
+
+// thrown by acquire() while the circuit breaker is open
+class Pool_unavailable : public std::runtime_error {
+public:
+    explicit Pool_unavailable(const char *msg) : std::runtime_error(msg) {}
+};
+
+// how often and how long acquire had to wait for a connection
+struct Wait_stats {
+    uint64_t waits{0};
+    uint64_t timeouts{0};
+    std::chrono::nanoseconds total_wait{0};
+    std::chrono::nanoseconds max_wait{0};
+    // waiting right now
+    size_t waiting{0};
+};
+
+// a connection held, from Pool::long_leases()
+struct Lease_info {
+    std::chrono::steady_clock::time_point acquired;
+    std::chrono::nanoseconds held{0};
+    // the thread it was handed to
+    std::thread::id thread;
+    // what was passed to acquire(tag), nullptr if nothing
+    const char *tag{nullptr};
+};
+
+// what a Pool has done since it was created, see Pool::stats()
+struct Pool_stats {
+    // connections handed out, from idle connections and by new ones
+    uint64_t acquires{0};
+    uint64_t hits{0};
+    // connections opened, and connects that threw or came up bad
+    uint64_t creations{0};
+    uint64_t connect_failures{0};
+    // given back and kept, given back and closed because bad or no room
+    uint64_t returns{0};
+    uint64_t discards{0};
+    // idle connections closed by the reaper or a failed validation
+    uint64_t evictions{0};
+    // opened in the background to replace bad ones, see Pool_config::replenish_rate
+    uint64_t replenished{0};
+    // right now, busy is acquires less what came back, idle includes thread caches
+    size_t open{0};
+    size_t idle{0};
+    size_t busy{0};
+    // empty unless Pool_config::collect_timing, hold_time also with tracked_leases
+    stats::Histogram_snapshot acquire_latency;
+    stats::Histogram_snapshot hold_time;
+    Wait_stats waits;
+};
+
+/**
+*
+* Get connection with Pool<Type>::get_entry(), this will reuse an idle connection or create
+* a new one, or wait for one if max_size is reached. The connection goes back to the pool
+* when the entry goes out of scope.
 *
-* Get connection with Pool<Type>::get_entry(), this will create a connection and return it but NOT pool it
-* Return the connection with Pool<Type>::return_entry
+* Pool<Type>::get_entry() uses the one pool per type, instance(). A Pool can also be
+* instantiated and used with acquire() if more than one is needed.
+* To configure instance(), change default_config() before the first get_entry().
+* Connections are created with the default constructor, unless a factory is passed.
+* The factory must construct the connection in the storage it is given.
+* ORDER picks which idle connection is handed out, Lifo, Fifo or Least_used.
 */
 
-template<class CONNECTION>
+template<class CONNECTION, class ORDER = Lifo>
 class Pool {
-    static void return_entry(CONNECTION *entry) {
-        g_pool.push_back(entry);
+public:
+    typedef Pool_entry<CONNECTION, Pool> entry_type;
+
+    friend class Pool_entry<CONNECTION, Pool>;
+
+    // construct a connection in storage, return storage
+    typedef std::function<CONNECTION *(void *storage)> factory_type;
+
+    // gets the entry from async_acquire(), empty if none could be had
+    typedef std::function<void(std::optional<entry_type>)> acquire_callback;
+
+    explicit Pool(const Pool_config &config = Pool_config(),
+                  factory_type factory = [](void *storage) { return new(storage) CONNECTION; })
+        : m_config(config), m_factory(std::move(factory)),
+          m_slab(config.slab_size ? std::make_unique<utilities::Slab<CONNECTION>>(config.slab_size) : nullptr),
+          m_idle(config.idle_capacity), m_caches(std::make_shared<Cache_registry>()) {
+        m_caches->pool = this;
+        if (config.tracked_leases) {
+            m_leases = std::make_unique<Lease_slot[]>(config.tracked_leases);
+            m_free_leases = std::make_unique<lock_free::Index_stack>(config.tracked_leases, true);
+        }
+        if (config.replenish_rate) {
+            m_replenishing = true;
+            m_replenisher = std::thread([this] { replenish(); });
+        }
     }
 
-public:
-    typedef std::vector<CONNECTION *> pool_vector;
-    static pool_vector g_pool;
-    typedef Pool_entry<CONNECTION, Pool<CONNECTION>> entry_type;
+    Pool(const Pool &) = delete;
+
+    Pool &operator=(const Pool &) = delete;
+
+    ~Pool() {
+        stop_watching();
+        {
+            std::lock_guard<std::mutex> lock(m_replenish_mutex);
+            m_replenishing = false;
+        }
+        m_replenish_wake.notify_all();
+        if (m_replenisher.joinable()) {
+            m_replenisher.join();
+        }
+        // async waiters still in line won't get anything
+        std::deque<Waiter *> waiters;
+        {
+            std::lock_guard<std::mutex> lock(m_wait_mutex);
+            waiters.swap(m_waiters);
+        }
+        for (Waiter *waiter: waiters) {
+            std::unique_ptr<Waiter> owned(waiter);
+            owned->callback(std::nullopt);
+        }
+        {
+            // threads still alive keep their cache object, but not the connections
+            std::lock_guard<std::mutex> lock(m_caches->mutex);
+            m_caches->pool = nullptr;
+            for (Thread_cache *cache: m_caches->caches) {
+                for (const Idle &idle: cache->connections) {
+                    dispose(idle.connection);
+                }
+                cache->connections.clear();
+            }
+            m_caches->caches.clear();
+        }
+        Idle idle;
+        while (m_idle.pop(idle)) {
+            dispose(idle.connection);
+        }
+    }
+
+    // the configuration instance() is created with
+    static Pool_config &default_config() {
+        static Pool_config config;
+        return config;
+    }
+
+    // the pool used by get_entry(), function local static so creation is thread safe
+    static Pool &instance() {
+        static Pool pool(default_config());
+        return pool;
+    }
+
+    /**
+     * @param tag what to call the lease in long_leases(), a string literal or something else
+     * that outlives the lease, like __func__
+     */
+    static entry_type get_entry(const char *tag = nullptr) {
+        return instance().acquire(tag);
+    }
+
+    /**
+     * Get an idle connection, or a new one. If max_size is reached, wait
+     * up to acquire_timeout for one to come back.
+     * @param tag see get_entry()
+     * @throws Pool_timeout if none came back in time
+     * @throws Pool_unavailable if the circuit breaker is open, or the connect failed
+     */
+    entry_type acquire(const char *tag = nullptr) {
+        not_connected() = false;
+        if (auto entry = try_acquire(m_config.acquire_timeout, tag)) {
+            return std::move(*entry);
+        }
+        // earlier failures don't matter if this one just didn't get a turn
+        if (not_connected() || breaker_open()) {
+            throw Pool_unavailable("connection pool can't connect");
+        }
+        throw Pool_timeout("connection pool exhausted");
+    }
 
-    friend class Pool_entry<CONNECTION, Pool<CONNECTION>>;
+    /**
+     * Like acquire() but doesn't throw
+     * @param timeout how long to wait if max_size is reached
+     * @param tag see get_entry()
+     * @return the entry, empty if none came back in time or the breaker is open
+     */
+    std::optional<entry_type> try_acquire(std::chrono::milliseconds timeout, const char *tag = nullptr) {
+        std::chrono::steady_clock::time_point start;
+        if (m_config.collect_timing) {
+            start = std::chrono::steady_clock::now();
+        }
+        auto entry = acquire_entry(timeout);
+        if (entry) {
+            if (m_config.collect_timing) {
+                m_acquire_latency.record(entry->acquired() - start);
+            }
+            if (tag && entry->lease().slot != lock_free::Index_stack::nil) {
+                m_leases[entry->lease().slot].tag.store(tag, std::memory_order_relaxed);
+            }
+        }
+        return entry;
+    }
 
-    static entry_type get_entry() {
-        if (g_pool.empty()) {
-            return entry_type();
+    /**
+     * Acquire without blocking the thread. The callback is called right away, on this
+     * thread, when a connection is idle or may be created. When max_size is reached it
+     * waits in line with the blocking acquires, and is called on the thread that gives
+     * a connection back, keep it short or post the work to your own loop.
+     * The callback gets an empty optional when the circuit breaker is open, when
+     * expire_waiters() finds it waited longer than timeout, or when the pool is destroyed.
+     * @throws what the factory throws when connecting right away, like acquire()
+     */
+    void async_acquire(std::chrono::milliseconds timeout, acquire_callback callback) {
+        bool wait = false;
+        auto entry = take_entry(wait);
+        if (wait) {
+            wait_async(timeout, std::move(callback));
         } else {
-            auto front = g_pool.front();
-            g_pool.erase(g_pool.begin());
-            return entry_type(front);
+            callback(std::move(entry));
+        }
+    }
+
+#ifdef OM_TOOLS_POOL_COROUTINES
+    /**
+     * co_await it for the entry, async_acquire() for coroutines. The coroutine is only
+     * suspended when it has to wait, and is resumed on the thread that gives a connection back.
+     */
+    class Acquire_awaiter {
+        Pool &m_pool;
+        std::chrono::milliseconds m_timeout;
+        std::optional<entry_type> m_entry;
+        // set by whichever comes first, the callback or the end of await_suspend()
+        std::atomic<bool> m_settled{false};
+
+    public:
+        Acquire_awaiter(Pool &pool, std::chrono::milliseconds timeout) : m_pool(pool), m_timeout(timeout) {}
+
+        bool await_ready() {
+            bool wait = false;
+            m_entry = m_pool.take_entry(wait);
+            return !wait;
+        }
+
+        // false if the wait was over before it started, the coroutine carries on without
+        // being resumed from inside here, on a stack that grows with every co_await
+        bool await_suspend(std::coroutine_handle<> handle) {
+            m_pool.wait_async(m_timeout, [this, handle](std::optional<entry_type> entry) {
+                m_entry = std::move(entry);
+                if (m_settled.exchange(true)) {
+                    handle.resume();
+                }
+            });
+            return !m_settled.exchange(true);
+        }
+
+        std::optional<entry_type> await_resume() { return std::move(m_entry); }
+    };
+
+    Acquire_awaiter async_acquire(std::chrono::milliseconds timeout) {
+        return Acquire_awaiter(*this, timeout);
+    }
+#endif
+
+    /**
+     * Time out the async_acquire() callers that waited longer than their timeout, their
+     * callback gets an empty optional. Call it from a timer, the blocking acquires time
+     * out on their own.
+     * @return number of callers timed out
+     */
+    size_t expire_waiters() {
+        std::vector<std::unique_ptr<Waiter>> expired;
+        {
+            auto now = std::chrono::steady_clock::now();
+            std::lock_guard<std::mutex> lock(m_wait_mutex);
+            for (auto iter = m_waiters.begin(); iter != m_waiters.end();) {
+                if ((*iter)->callback && (*iter)->deadline <= now) {
+                    expired.emplace_back(*iter);
+                    iter = m_waiters.erase(iter);
+                    m_waiting.fetch_sub(1);
+                } else {
+                    ++iter;
+                }
+            }
+        }
+        for (auto &waiter: expired) {
+            complete(std::move(waiter));
+        }
+        return expired.size();
+    }
+
+    /**
+     * The connections handed out longer ago than threshold, with Pool_config::tracked_leases.
+     * Read without locks while the owners go on, a lease given back while looking may or
+     * may not be in the list.
+     * @return the leases held longer, the longest first
+     */
+    [[nodiscard]]
+    std::vector<Lease_info> long_leases(std::chrono::milliseconds threshold) const {
+        std::vector<Lease_info> leases;
+        auto now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < m_config.tracked_leases; ++i) {
+            const Lease_slot &slot = m_leases[i];
+            auto acquired = slot.acquired.load(std::memory_order_acquire);
+            if (acquired == 0) {
+                continue;
+            }
+            Lease_info info;
+            info.acquired = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(acquired));
+            info.held = now - info.acquired;
+            info.thread = slot.thread.load(std::memory_order_relaxed);
+            info.tag = slot.tag.load(std::memory_order_relaxed);
+            // given back, or given back and taken again, while reading it
+            if (info.held < threshold || slot.acquired.load(std::memory_order_acquire) != acquired) {
+                continue;
+            }
+            leases.push_back(info);
+        }
+        std::sort(leases.begin(), leases.end(), [](const Lease_info &left, const Lease_info &right) {
+            return left.held > right.held;
+        });
+        return leases;
+    }
+
+    /**
+     * Report the long leases on a thread of its own, every interval. Replaces the
+     * watch from an earlier call, the pool's destructor stops it. report may call
+     * stop_watching() or watch_leases() itself.
+     * @param threshold see long_leases()
+     * @param report called with the long leases, not called when there are none
+     */
+    void watch_leases(std::chrono::milliseconds threshold, std::chrono::milliseconds interval,
+                      std::function<void(const std::vector<Lease_info> &)> report) {
+        stop_watching();
+        std::thread retired;
+        {
+            std::lock_guard<std::mutex> lock(m_watch_mutex);
+            if (m_watchdog.joinable()) {
+                // from report, this thread ends when it returns, joined with the next one
+                retired = std::move(m_retired_watchdog);
+                m_retired_watchdog = std::move(m_watchdog);
+            }
+            // started under the lock, it doesn't look at m_watchdog before it is set
+            m_watchdog = std::thread([this, threshold, interval, generation = m_watch_generation,
+                                      report = std::move(report)] {
+                std::unique_lock<std::mutex> lock(m_watch_mutex);
+                while (!m_watch_stop.wait_for(lock, interval, [this, generation] {
+                    return m_watch_generation != generation;
+                })) {
+                    // not under the lock, report may stop the watch
+                    lock.unlock();
+                    auto leases = long_leases(threshold);
+                    if (!leases.empty()) {
+                        report(leases);
+                    }
+                    lock.lock();
+                }
+            });
+        }
+        if (retired.joinable()) {
+            retired.join();
+        }
+    }
+
+    void stop_watching() {
+        std::thread watchdog;
+        std::thread retired;
+        {
+            std::lock_guard<std::mutex> lock(m_watch_mutex);
+            ++m_watch_generation;
+            // from report the watchdog can't join itself, it ends when report returns
+            if (m_watchdog.get_id() != std::this_thread::get_id()) {
+                watchdog = std::move(m_watchdog);
+            }
+            if (m_retired_watchdog.get_id() != std::this_thread::get_id()) {
+                retired = std::move(m_retired_watchdog);
+            }
+        }
+        m_watch_stop.notify_all();
+        if (watchdog.joinable()) {
+            watchdog.join();
+        }
+        if (retired.joinable()) {
+            retired.join();
+        }
+    }
+
+    /**
+     * Close the idle connections that have been unused longer than idle_ttl, but
+     * keep min_idle. Does nothing if another thread is already at it.
+     * @return number of connections closed
+     */
+    size_t reap() {
+        if (!m_config.idle_ttl.count() || m_reaping.test_and_set(std::memory_order_acquire)) {
+            return 0;
+        }
+        auto expired_before = std::chrono::steady_clock::now() - m_config.idle_ttl;
+        std::vector<Idle> idle_list;
+        std::vector<CONNECTION *> expired;
+        idle_list.reserve(m_idle.size());
+        Idle idle;
+        while (m_idle.pop(idle)) {
+            idle_list.push_back(idle);
+        }
+        // newest first, whatever order they came off in
+        std::sort(idle_list.begin(), idle_list.end(), [](const Idle &left, const Idle &right) {
+            return left.since > right.since;
+        });
+        size_t keep = 0;
+        while (keep < idle_list.size() &&
+               (idle_list[keep].since >= expired_before || keep < m_config.min_idle)) {
+            ++keep;
+        }
+        for (size_t i = keep; i < idle_list.size(); ++i) {
+            expired.push_back(idle_list[i].connection);
         }
+        // give the keepers back before closing the others, oldest first so the order stays
+        for (size_t i = keep; i > 0; --i) {
+            if (m_idle.push(idle_list[i - 1])) {
+                hand_off();
+            } else {
+                expired.push_back(idle_list[i - 1].connection);
+            }
+        }
+        m_reaping.clear(std::memory_order_release);
+        m_evictions.add(static_cast<int64_t>(expired.size()));
+        for (CONNECTION *connection: expired) {
+            destroy(connection);
+        }
+        return expired.size();
+    }
+
+    /**
+     * Open connections concurrently and keep them idle in the pool, but not more
+     * than max_size allows.
+     * @param count number of connections to open
+     * @param threads max number of connections opened at the same time
+     * @return connect latency of each connection opened, in no particular order
+     */
+    std::vector<Warm_result> warm(size_t count, size_t threads = 16) {
+        std::vector<Warm_result> results(count);
+        std::atomic<size_t> next{0};
+        auto opener = [this, count, &results, &next] {
+            while (reserve()) {
+                size_t index = next++;
+                if (index >= count) {
+                    destroyed(); // the slot reserved
+                    break;
+                }
+                auto start = std::chrono::steady_clock::now();
+                CONNECTION *connection = nullptr;
+                try {
+                    connection = connect();
+                } catch (const std::exception &) { /*failed*/ }
+                auto &result = results[index];
+                result.latency = std::chrono::steady_clock::now() - start;
+                if (connection && connection->good_connection()) {
+                    result.good = true;
+                    if (!return_shared(connection, 0)) {
+                        destroy(connection);
+                    }
+                } else if (connection) {
+                    destroy(connection);
+                }
+            }
+        };
+        std::vector<std::thread> openers;
+        for (size_t i = 1; i < std::min(count, threads); ++i) {
+            openers.emplace_back(opener);
+        }
+        opener();
+        for (auto &thread: openers) {
+            thread.join();
+        }
+        // fewer if max_size was reached
+        results.resize(std::min(count, next.load()));
+        return results;
+    }
+
+    // is the circuit breaker failing connects right now
+    [[nodiscard]]
+    bool breaker_open() const noexcept {
+        return m_config.breaker_threshold &&
+               m_failures.load(std::memory_order_relaxed) >= m_config.breaker_threshold;
     }
+
+    // number of idle connections in the shared stack, a snapshot
+    [[nodiscard]]
+    size_t idle() const noexcept { return m_idle.size(); }
+
+    // number of open connections, idle and in use, a snapshot
+    [[nodiscard]]
+    size_t open() const noexcept { return m_open.load(std::memory_order_relaxed); }
+
+    [[nodiscard]]
+    Wait_stats wait_stats() const noexcept {
+        Wait_stats stats;
+        stats.waits = m_waits.load(std::memory_order_relaxed);
+        stats.timeouts = m_timeouts.load(std::memory_order_relaxed);
+        stats.total_wait = std::chrono::nanoseconds(m_total_wait_ns.load(std::memory_order_relaxed));
+        stats.max_wait = std::chrono::nanoseconds(m_max_wait_ns.load(std::memory_order_relaxed));
+        stats.waiting = m_waiting.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    /**
+     * What the pool has done so far, read without locks. The counters are read one
+     * by one while other threads go on, they may not add up exactly.
+     */
+    [[nodiscard]]
+    Pool_stats stats() const noexcept {
+        Pool_stats stats;
+        // what came back before what went out, everything counted back was counted out already
+        stats.returns = static_cast<uint64_t>(m_returns.load());
+        stats.discards = static_cast<uint64_t>(m_discards.load());
+        stats.acquires = static_cast<uint64_t>(m_acquires.load());
+        stats.hits = static_cast<uint64_t>(m_hits.load());
+        stats.creations = static_cast<uint64_t>(m_creations.load());
+        stats.connect_failures = static_cast<uint64_t>(m_connect_failures.load());
+        stats.evictions = static_cast<uint64_t>(m_evictions.load());
+        stats.replenished = static_cast<uint64_t>(m_replenished.load());
+        stats.open = open();
+        auto given_back = stats.returns + stats.discards;
+        stats.busy = stats.acquires > given_back ? static_cast<size_t>(stats.acquires - given_back) : 0;
+        stats.idle = stats.open > stats.busy ? stats.open - stats.busy : 0;
+        stats.acquire_latency = m_acquire_latency.snapshot();
+        stats.hold_time = m_hold_time.snapshot();
+        stats.waits = wait_stats();
+        return stats;
+    }
+
+    [[nodiscard]]
+    const Pool_config &config() const noexcept { return m_config; }
+
+private:
+    // an idle connection, when it came back and how many times it has been handed out
+    struct Idle {
+        CONNECTION *connection{nullptr};
+        std::chrono::steady_clock::time_point since{};
+        uint32_t uses{0};
+    };
+
+    struct Thread_cache;
+
+    // shared by the pool and the thread caches, outlives whichever goes first
+    struct Cache_registry {
+        std::mutex mutex;
+        Pool *pool{nullptr};
+        std::vector<Thread_cache *> caches;
+    };
+
+    struct Thread_cache {
+        std::shared_ptr<Cache_registry> registry;
+        std::vector<Idle> connections;
+
+        explicit Thread_cache(std::shared_ptr<Cache_registry> caches) : registry(std::move(caches)) {}
+
+        Thread_cache(const Thread_cache &) = delete;
+
+        // thread exit, hand the connections back
+        ~Thread_cache() {
+            std::lock_guard<std::mutex> lock(registry->mutex);
+            if (registry->pool) {
+                for (const Idle &idle: connections) {
+                    if (!registry->pool->return_shared(idle.connection, idle.uses)) {
+                        registry->pool->destroy(idle.connection);
+                    }
+                }
+                auto &caches = registry->caches;
+                caches.erase(std::remove(caches.begin(), caches.end(), this), caches.end());
+            }
+        }
+    };
+
+    // the calling thread's cache for this pool, created on first use
+    Thread_cache &thread_cache() {
+        static thread_local std::vector<std::unique_ptr<Thread_cache>> t_caches;
+        for (auto &cache: t_caches) {
+            if (cache->registry == m_caches) {
+                return *cache;
+            }
+        }
+        // first use from this thread, drop the caches of pools that are gone while at it
+        t_caches.erase(std::remove_if(t_caches.begin(), t_caches.end(), [](const auto &cache) {
+            std::lock_guard<std::mutex> lock(cache->registry->mutex);
+            return cache->registry->pool == nullptr;
+        }), t_caches.end());
+        auto cache = std::make_unique<Thread_cache>(m_caches);
+        cache->connections.reserve(m_config.thread_cache_size);
+        {
+            std::lock_guard<std::mutex> lock(m_caches->mutex);
+            m_caches->caches.push_back(cache.get());
+        }
+        t_caches.push_back(std::move(cache));
+        return *t_caches.back();
+    }
+
+    // try_acquire() without the timing
+    std::optional<entry_type> acquire_entry(std::chrono::milliseconds timeout) {
+        bool wait = false;
+        auto entry = take_entry(wait);
+        if (wait) {
+            return wait_for_entry(timeout);
+        }
+        return entry;
+    }
+
+    // an idle connection or a new one, or wait is set if the caller has to wait for one
+    std::optional<entry_type> take_entry(bool &wait) {
+        if (m_config.idle_ttl.count()) {
+            reap_when_due();
+        }
+        if (m_config.thread_cache_size) {
+            auto &cached = thread_cache().connections;
+            while (!cached.empty()) {
+                Idle idle = cached.back();
+                cached.pop_back();
+                if (alive(idle)) {
+                    m_hits.add();
+                    return lease(idle);
+                }
+                m_evictions.add();
+                destroy(idle.connection);
+                replace_later();
+            }
+        }
+        // don't jump the queue if others are waiting already
+        if (!queued()) {
+            Idle idle;
+            while (take_idle(idle)) {
+                if (alive(idle)) {
+                    m_hits.add();
+                    return lease(idle);
+                }
+                m_evictions.add();
+                destroy(idle.connection);
+                replace_later();
+            }
+            if (reserve()) {
+                return connect_entry();
+            }
+        }
+        wait = true;
+        return std::nullopt;
+    }
+
+    // hand out a connection, it is in use until the entry gives it back
+    entry_type lease(const Idle &idle) noexcept {
+        m_acquires.add();
+        Lease lease;
+        lease.uses = idle.uses + 1;
+        if (m_config.collect_timing || m_config.tracked_leases) {
+            lease.acquired = std::chrono::steady_clock::now();
+        }
+        if (m_config.tracked_leases && m_free_leases->pop(lease.slot)) {
+            Lease_slot &slot = m_leases[lease.slot];
+            slot.thread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+            slot.tag.store(nullptr, std::memory_order_relaxed);
+            // last, the watchdog reads the others after seeing this
+            slot.acquired.store(lease.acquired.time_since_epoch().count(), std::memory_order_release);
+        }
+        return entry_type(idle.connection, this, lease);
+    }
+
+    // a caller waiting in acquire, the connection or the permission to create one is handed over
+    struct Waiter {
+        std::condition_variable ready;
+        Idle idle;
+        bool may_create{false};
+        bool done{false};
+        // async_acquire(), called back instead of waking a thread
+        acquire_callback callback;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    bool take_idle(Idle &idle) {
+        return m_idle.pop(idle);
+    }
+
+    // probe a connection that has been idle longer than validate_after
+    bool alive(const Idle &idle) const {
+        if (!m_config.validate_after.count() ||
+            std::chrono::steady_clock::now() - idle.since < m_config.validate_after) {
+            return true;
+        }
+        if constexpr (has_test_connection<CONNECTION>::value) {
+            return idle.connection->test_connection();
+        } else {
+            return idle.connection->good_connection();
+        }
+    }
+
+    // one acquire() every reap_interval does the sweep
+    void reap_when_due() {
+        auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+        auto due = m_next_reap.load(std::memory_order_relaxed);
+        if (now >= due && m_next_reap.compare_exchange_strong(
+            due, now + std::chrono::steady_clock::duration(m_config.reap_interval).count(),
+            std::memory_order_relaxed)) {
+            reap();
+        }
+    }
+
+    [[nodiscard]]
+    bool queued() const noexcept {
+        return m_config.max_size && m_waiting.load(std::memory_order_relaxed) != 0;
+    }
+
+    // count a connection about to be created, false if max_size is reached
+    bool reserve() noexcept {
+        size_t open = m_open.load();
+        do {
+            if (m_config.max_size && open >= m_config.max_size) {
+                return false;
+            }
+        } while (!m_open.compare_exchange_weak(open, open + 1));
+        return true;
+    }
+
+    CONNECTION *create() {
+        void *storage = m_slab ? m_slab->allocate() : nullptr;
+        if (!storage) {
+            storage = std::allocator<CONNECTION>().allocate(1);
+        }
+        try {
+            CONNECTION *connection = m_factory(storage);
+            m_creations.add();
+            return connection;
+        } catch (...) {
+            m_connect_failures.add();
+            release(storage);
+            destroyed();
+            throw;
+        }
+    }
+
+    /**
+     * Create a connection in a reserved slot, unless the circuit breaker is open.
+     * With the breaker enabled, a connection that comes up bad counts as a failure
+     * and is closed, without it the caller gets to find out, like it always has.
+     * @return the connection, nullptr if the breaker is open or the connect failed
+     */
+    CONNECTION *connect() {
+        if (!m_config.breaker_threshold) {
+            return create();
+        }
+        if (!allow_connect()) {
+            destroyed(); // the slot reserved
+            return nullptr;
+        }
+        CONNECTION *connection = nullptr;
+        try {
+            connection = create();
+        } catch (...) {
+            connect_failed();
+            throw;
+        }
+        if (connection->good_connection()) {
+            m_failures.store(0, std::memory_order_relaxed);
+            return connection;
+        }
+        m_connect_failures.add();
+        connect_failed();
+        destroy(connection);
+        return nullptr;
+    }
+
+    std::optional<entry_type> connect_entry() {
+        if (CONNECTION *connection = connect()) {
+            return lease(Idle{connection});
+        }
+        not_connected() = true;
+        return std::nullopt;
+    }
+
+    // set when this thread's connect was refused by the breaker or failed, for acquire()
+    static bool &not_connected() noexcept {
+        static thread_local bool t_not_connected = false;
+        return t_not_connected;
+    }
+
+    // closed, or open but the cooldown is over and this caller is the one to try
+    bool allow_connect() noexcept {
+        if (m_failures.load(std::memory_order_relaxed) < m_config.breaker_threshold) {
+            return true;
+        }
+        auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+        auto retry_at = m_retry_at.load(std::memory_order_relaxed);
+        // the others keep failing fast while this one tries
+        return now >= retry_at && m_retry_at.compare_exchange_strong(
+            retry_at, now + std::chrono::steady_clock::duration(m_config.breaker_cooldown).count(),
+            std::memory_order_relaxed);
+    }
+
+    void connect_failed() noexcept {
+        if (m_failures.fetch_add(1, std::memory_order_relaxed) + 1 >= m_config.breaker_threshold) {
+            auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+            m_retry_at.store(now + std::chrono::steady_clock::duration(m_config.breaker_cooldown).count(),
+                             std::memory_order_relaxed);
+        }
+    }
+
+    void destroy(CONNECTION *entry) {
+        dispose(entry);
+        destroyed();
+    }
+
+    void dispose(CONNECTION *entry) {
+        std::destroy_at(entry);
+        release(entry);
+    }
+
+    // the storage, back to the slab or the heap, whichever it came from
+    void release(void *storage) {
+        if (m_slab && m_slab->owns(storage)) {
+            m_slab->deallocate(storage);
+        } else {
+            std::allocator<CONNECTION>().deallocate(static_cast<CONNECTION *>(storage), 1);
+        }
+    }
+
+    // a connection is gone, someone waiting may create a new one
+    void destroyed() {
+        m_open.fetch_sub(1);
+        hand_off();
+    }
+
+    std::optional<entry_type> wait_for_entry(std::chrono::milliseconds timeout) {
+        Waiter waiter;
+        waiter.start = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(m_wait_mutex);
+        // seq_cst, pairs with the load in hand_off()
+        m_waiting.fetch_add(1);
+        // something may have come back since we looked, but only take it if first in line
+        if (m_waiters.empty() && (take_idle(waiter.idle) || (waiter.may_create = reserve()))) {
+            waiter.done = true;
+        } else {
+            m_waiters.push_back(&waiter);
+            if (!waiter.ready.wait_until(lock, waiter.start + timeout, [&waiter] { return waiter.done; })) {
+                m_waiters.erase(std::find(m_waiters.begin(), m_waiters.end(), &waiter));
+            }
+        }
+        m_waiting.fetch_sub(1);
+        lock.unlock();
+
+        waited(waiter);
+        bool retry = false;
+        auto entry = handed_over(waiter, retry);
+        if (retry) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                waiter.start + timeout - std::chrono::steady_clock::now());
+            return acquire_entry(std::max(left, std::chrono::milliseconds(0)));
+        }
+        return entry;
+    }
+
+    // the async version, the callback is called when the wait is over
+    void wait_async(std::chrono::milliseconds timeout, acquire_callback callback) {
+        auto waiter = std::make_unique<Waiter>();
+        waiter->callback = std::move(callback);
+        waiter->start = std::chrono::steady_clock::now();
+        waiter->deadline = waiter->start + timeout;
+        {
+            std::lock_guard<std::mutex> lock(m_wait_mutex);
+            m_waiting.fetch_add(1);
+            if (!m_waiters.empty() || (!take_idle(waiter->idle) && !(waiter->may_create = reserve()))) {
+                // hand_off() or expire_waiters() completes it
+                m_waiters.push_back(waiter.release());
+                return;
+            }
+            m_waiting.fetch_sub(1);
+            waiter->done = true;
+        }
+        complete(std::move(waiter));
+    }
+
+    // an async wait is over, call back with what it was handed
+    void complete(std::unique_ptr<Waiter> waiter) noexcept {
+        waited(*waiter);
+        bool retry = false;
+        std::optional<entry_type> entry;
+        try {
+            entry = handed_over(*waiter, retry);
+        } catch (const std::exception &) {
+            // the connect threw, on some other caller's thread, nowhere to throw it
+        }
+        if (retry) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                waiter->deadline - std::chrono::steady_clock::now());
+            wait_async(std::max(left, std::chrono::milliseconds(0)), std::move(waiter->callback));
+            return;
+        }
+        waiter->callback(std::move(entry));
+    }
+
+    void waited(const Waiter &waiter) noexcept {
+        auto waited = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - waiter.start).count());
+        m_waits.fetch_add(1, std::memory_order_relaxed);
+        m_total_wait_ns.fetch_add(waited, std::memory_order_relaxed);
+        auto max_wait = m_max_wait_ns.load(std::memory_order_relaxed);
+        while (waited > max_wait &&
+               !m_max_wait_ns.compare_exchange_weak(max_wait, waited, std::memory_order_relaxed)) {}
+        if (!waiter.done) {
+            m_timeouts.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * What the waiter was handed, the connection or the permission to create one.
+     * @param retry set if the connection handed over was broken, wait again with the time left
+     * @return the entry, empty if nothing was handed over or the connect failed
+     */
+    std::optional<entry_type> handed_over(Waiter &waiter, bool &retry) {
+        if (waiter.idle.connection) {
+            if (alive(waiter.idle)) {
+                m_hits.add();
+                return lease(waiter.idle);
+            }
+            m_evictions.add();
+            destroy(waiter.idle.connection);
+            replace_later();
+            retry = true;
+            return std::nullopt;
+        }
+        if (waiter.may_create) {
+            return connect_entry();
+        }
+        return std::nullopt;
+    }
+
+    // give idle connections, or free slots, to the waiters in the order they came
+    void hand_off() {
+        if (!m_config.max_size) {
+            return;
+        }
+        // seq_cst like the push and the waiter's increment, either the waiter sees
+        // what was just returned or we see it waiting
+        if (m_waiting.load() == 0) {
+            return;
+        }
+        std::vector<std::unique_ptr<Waiter>> called_back;
+        {
+            std::lock_guard<std::mutex> lock(m_wait_mutex);
+            while (!m_waiters.empty()) {
+                Waiter *waiter = m_waiters.front();
+                if (!take_idle(waiter->idle) && !(waiter->may_create = reserve())) {
+                    break;
+                }
+                m_waiters.pop_front();
+                waiter->done = true;
+                if (waiter->callback) {
+                    // a blocking waiter leaves the count itself, this one can't
+                    m_waiting.fetch_sub(1);
+                    called_back.emplace_back(waiter);
+                } else {
+                    waiter->ready.notify_one();
+                }
+            }
+        }
+        if (called_back.empty()) {
+            return;
+        }
+        // not under the lock, the callback may well acquire or give back. Giving back
+        // comes here again, that is queued to the outermost call on this thread rather
+        // than a recursion as deep as the line of waiters
+        static thread_local std::deque<std::pair<Pool *, std::unique_ptr<Waiter>>> *t_pending = nullptr;
+        bool outermost = !t_pending;
+        std::deque<std::pair<Pool *, std::unique_ptr<Waiter>>> pending;
+        if (outermost) {
+            t_pending = &pending;
+        }
+        for (auto &waiter: called_back) {
+            t_pending->emplace_back(this, std::move(waiter));
+        }
+        if (outermost) {
+            while (!pending.empty()) {
+                auto [pool, waiter] = std::move(pending.front());
+                pending.pop_front();
+                pool->complete(std::move(waiter));
+            }
+            t_pending = nullptr;
+        }
+    }
+
+    void return_entry(CONNECTION *entry, const Lease &lease) {
+        if (m_config.collect_timing || m_config.tracked_leases) {
+            m_hold_time.record(std::chrono::steady_clock::now() - lease.acquired);
+        }
+        if (lease.slot != lock_free::Index_stack::nil) {
+            m_leases[lease.slot].acquired.store(0, std::memory_order_release);
+            m_free_leases->push(lease.slot);
+        }
+        uint32_t uses = lease.uses;
+        if (!entry->good_connection()) {
+            m_discards.add();
+            destroy(entry);
+            replace_later();
+            return;
+        }
+        entry->reset();
+        // don't keep it to this thread when others are waiting
+        if (m_config.thread_cache_size && !queued()) {
+            auto &cached = thread_cache().connections;
+            if (cached.size() < m_config.thread_cache_size) {
+                cached.push_back(Idle{entry, std::chrono::steady_clock::now(), uses});
+                m_returns.add();
+                return;
+            }
+        }
+        if (return_shared(entry, uses)) {
+            m_returns.add();
+            return;
+        }
+        // no room, closed but not replaced
+        m_discards.add();
+        destroy(entry);
+    }
+
+    // a bad connection was closed, have the replenisher open another
+    void replace_later() {
+        if (!m_config.replenish_rate) {
+            return;
+        }
+        {
+            // under the lock, or the wake up may come between the replenisher's check and its wait
+            std::lock_guard<std::mutex> lock(m_replenish_mutex);
+            if (m_owed >= m_config.idle_capacity) {
+                return;
+            }
+            ++m_owed;
+        }
+        m_replenish_wake.notify_one();
+    }
+
+    // the replenisher thread, one replacement per 1/replenish_rate second at most
+    void replenish() {
+        auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::seconds(1)) / m_config.replenish_rate;
+        std::unique_lock<std::mutex> lock(m_replenish_mutex);
+        while (true) {
+            m_replenish_wake.wait(lock, [this] { return !m_replenishing || m_owed; });
+            if (!m_replenishing) {
+                return;
+            }
+            lock.unlock();
+            bool done = replace_one();
+            lock.lock();
+            if (done) {
+                --m_owed;
+            }
+            // the rate limit, also the pause before trying a failed one again
+            if (m_replenish_wake.wait_for(lock, interval, [this] { return !m_replenishing; })) {
+                return;
+            }
+        }
+    }
+
+    // false if the connect failed and should be tried again
+    bool replace_one() {
+        if (!reserve()) {
+            // max_size reached, callers opened their own in the meantime
+            return true;
+        }
+        CONNECTION *connection = nullptr;
+        try {
+            connection = connect();
+        } catch (...) {
+            // create() counted the failure and gave back the slot
+            return false;
+        }
+        if (!connection) {
+            return false;
+        }
+        if (!connection->good_connection()) {
+            m_connect_failures.add();
+            destroy(connection);
+            return false;
+        }
+        m_replenished.add();
+        if (!return_shared(connection, 0)) {
+            destroy(connection);
+        }
+        return true;
+    }
+
+    // false if there is no room for it, the caller closes it
+    bool return_shared(CONNECTION *entry, uint32_t uses) {
+        if (m_idle.push(Idle{entry, std::chrono::steady_clock::now(), uses})) {
+            hand_off();
+            return true;
+        }
+        return false;
+    }
+
+    const Pool_config m_config;
+    const factory_type m_factory;
+    std::unique_ptr<utilities::Slab<CONNECTION>> m_slab;
+    typename ORDER::template idle_list<Idle> m_idle;
+    std::shared_ptr<Cache_registry> m_caches;
+
+    alignas(lock_free::cache_line_size) std::atomic<size_t> m_open{0};
+    alignas(lock_free::cache_line_size) std::atomic<size_t> m_waiting{0};
+    std::mutex m_wait_mutex;
+    std::deque<Waiter *> m_waiters;
+
+    std::atomic<uint64_t> m_waits{0};
+    std::atomic<uint64_t> m_timeouts{0};
+    std::atomic<uint64_t> m_total_wait_ns{0};
+    std::atomic<uint64_t> m_max_wait_ns{0};
+
+    std::atomic<std::chrono::steady_clock::rep> m_next_reap{0};
+    std::atomic_flag m_reaping = ATOMIC_FLAG_INIT;
+
+    // consecutive failed connects, and when the open breaker lets the next one try
+    std::atomic<uint32_t> m_failures{0};
+    std::atomic<std::chrono::steady_clock::rep> m_retry_at{0};
+
+    stats::Counter m_acquires;
+    stats::Counter m_hits;
+    stats::Counter m_creations;
+    stats::Counter m_connect_failures;
+    stats::Counter m_returns;
+    stats::Counter m_discards;
+    stats::Counter m_evictions;
+    stats::Counter m_replenished;
+    stats::Histogram m_acquire_latency;
+    stats::Histogram m_hold_time;
+
+    // a lease handed out, acquired is 0 when the slot is free
+    struct alignas(lock_free::cache_line_size) Lease_slot {
+        std::atomic<std::chrono::steady_clock::rep> acquired{0};
+        std::atomic<std::thread::id> thread{};
+        std::atomic<const char *> tag{nullptr};
+    };
+    std::unique_ptr<Lease_slot[]> m_leases;
+    std::unique_ptr<lock_free::Index_stack> m_free_leases;
+
+    std::thread m_watchdog;
+    // a watchdog replaced from its own report, still on its way out
+    std::thread m_retired_watchdog;
+    std::mutex m_watch_mutex;
+    std::condition_variable m_watch_stop;
+    // a watchdog stops when this is no longer the one it started with
+    uint64_t m_watch_generation{0};
+
+    // bad connections closed and not yet replaced, under m_replenish_mutex
+    std::thread m_replenisher;
+    std::mutex m_replenish_mutex;
+    std::condition_variable m_replenish_wake;
+    size_t m_owed{0};
+    bool m_replenishing{false};
 };
 
-template<class CONNECTION>
-std::vector<CONNECTION *> Pool<CONNECTION>::g_pool;
+/**
+ * One Pool per key, the key is typically the connection string or "host:port".
+ *
+ * The sub pools are created on first use and live as long as the Keyed_pool, a
+ * reference from pool(key) stays valid. Finding the pool is a hash lookup under
+ * a shared lock, only the first use of a key takes the exclusive lock.
+ */
+template<class CONNECTION, class ORDER = Lifo>
+class Keyed_pool {
+public:
+    typedef Pool<CONNECTION, ORDER> pool_type;
+    typedef typename pool_type::entry_type entry_type;
+    // construct a connection for key in storage, return storage
+    typedef std::function<CONNECTION *(void *storage, const std::string &key)> factory_type;
+
+    /**
+     * @param config for keys without a config of their own
+     * @param factory creates a connection for a key, the default passes the key to the constructor
+     */
+    explicit Keyed_pool(const Pool_config &config = Pool_config(),
+                        factory_type factory = [](void *storage, const std::string &key) {
+                            return new(storage) CONNECTION(key);
+                        })
+        : m_default_config(config), m_factory(std::move(factory)) {}
+
+    Keyed_pool(const Keyed_pool &) = delete;
+
+    Keyed_pool &operator=(const Keyed_pool &) = delete;
+
+    /**
+     * Give a key its own config, max_size for example.
+     * Only affects a key that hasn't been used yet.
+     */
+    void configure(std::string_view key, const Pool_config &config) {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        m_configs[std::string(key)] = config;
+    }
+
+    // the pool for key, created on first use
+    pool_type &pool(std::string_view key) {
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            if (auto found = m_pools.find(key); found != m_pools.end()) {
+                return found->second->pool;
+            }
+        }
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        if (auto found = m_pools.find(key); found != m_pools.end()) {
+            return found->second->pool; // another thread got here first
+        }
+        auto config = m_configs.find(std::string(key));
+        auto sub_pool = std::make_unique<Sub_pool>(
+            key, config == m_configs.end() ? m_default_config : config->second, m_factory);
+        std::string_view stable_key = sub_pool->key;
+        return m_pools.emplace(stable_key, std::move(sub_pool)).first->second->pool;
+    }
+
+    entry_type acquire(std::string_view key, const char *tag = nullptr) {
+        return pool(key).acquire(tag);
+    }
+
+    std::optional<entry_type> try_acquire(std::string_view key, std::chrono::milliseconds timeout,
+                                          const char *tag = nullptr) {
+        return pool(key).try_acquire(timeout, tag);
+    }
+
+    // number of keys in use
+    [[nodiscard]]
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        return m_pools.size();
+    }
+
+private:
+    // owns the key the map looks up by, so lookups don't need to allocate a string
+    struct Sub_pool {
+        const std::string key;
+        pool_type pool;
+
+        Sub_pool(std::string_view sub_key, const Pool_config &config, const factory_type &factory)
+            : key(sub_key), pool(config, [this, factory](void *storage) { return factory(storage, key); }) {}
+    };
+
+    const Pool_config m_default_config;
+    const factory_type m_factory;
+    mutable std::shared_mutex m_mutex;
+    std::unordered_map<std::string_view, std::unique_ptr<Sub_pool>> m_pools;
+    std::unordered_map<std::string, Pool_config> m_configs;
+};
 
 #if __cplusplus >= 201103L
 }
 #endif
 
 }
-
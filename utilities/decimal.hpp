@@ -0,0 +1,433 @@
+#pragma once
+
+/**
+ * Fixed point decimal for PG numeric and money columns, prices and sums that must add up
+ * to the cent, which a double doesn't.
+ *
+ * A Decimal<SCALE> is an int64_t count of units of 10^-SCALE, Decimal<2> holds cents,
+ * 18 digits in all, 92233720368547758.07 is the largest Decimal<2>. Adding and subtracting
+ * is exact and throws std::overflow_error instead of wrapping.
+ *
+ * Text is read and written with from_chars() and to_chars(), like the std ones, no locale,
+ * no stream, no allocation. That is what lex_cast and lex_format use, so Params::add() and
+ * Scoped_result::get_value<>() take them like any number. Text is PG numeric output,
+ * "-1234.5678", or money, "-$1,234.56". Digits past SCALE are rounded half away from zero,
+ * like PG rounds numeric to a smaller scale, to_chars() writes all SCALE of them.
+ * "NaN", "Infinity" and exponents aren't read.
+ *
+ * from_pg_numeric() and from_pg_money() read the binary format, for results in binary.
+ *
+ * Usage:
+ *  Money total;
+ *  for (auto row = result.begin(); row != end; ++row) {
+ *      total += row.get<Money>(0);
+ *  }
+ *  params.add(total);  // "1234.56"
+ */
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <typeinfo>
+
+namespace om_tools::utilities {
+#if __cplusplus >= 201103L
+inline namespace v1_0_0 {
+#endif
+
+namespace decimal_detail {
+
+constexpr uint64_t pow10(int exponent) noexcept {
+    uint64_t result = 1;
+    for (int i = 0; i < exponent; ++i) {
+        result *= 10;
+    }
+    return result;
+}
+
+// the magnitude of a Decimal, a digit at a time, from text or a binary numeric
+template<int SCALE>
+struct Accumulator {
+    // 2^63, the magnitude of INT64_MIN
+    static constexpr uint64_t limit = uint64_t(1) << 63;
+    uint64_t magnitude = 0;
+    int fraction_digits = 0;
+    bool round_up = false;
+    bool overflow = false;
+
+    void integer_digit(unsigned digit) noexcept {
+        if (magnitude > (limit - digit) / 10) {
+            overflow = true;
+        } else {
+            magnitude = magnitude * 10 + digit;
+        }
+    }
+
+    void fraction_digit(unsigned digit) noexcept {
+        if (fraction_digits < SCALE) {
+            integer_digit(digit);
+        } else if (fraction_digits == SCALE) {
+            // the first one past the scale decides, half away from zero
+            round_up = digit >= 5;
+        }
+        ++fraction_digits;
+    }
+
+    // the units, result_out_of_range if they don't fit
+    std::errc finish(bool negative, int64_t &units) noexcept {
+        for (; fraction_digits < SCALE; ++fraction_digits) {
+            integer_digit(0);
+        }
+        if (round_up && !overflow) {
+            // at most limit + 1, caught below
+            ++magnitude;
+        }
+        if (overflow || magnitude > limit - (negative ? 0 : 1)) {
+            return std::errc::result_out_of_range;
+        }
+        units = negative ? static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude);
+        return std::errc();
+    }
+};
+
+#if defined(__GNUC__)
+#define OM_TOOLS_OVERFLOW_BUILTINS
+#elif defined(__has_builtin)
+#if __has_builtin(__builtin_add_overflow) && __has_builtin(__builtin_sub_overflow) && __has_builtin(__builtin_mul_overflow)
+#define OM_TOOLS_OVERFLOW_BUILTINS
+#endif
+#endif
+
+// result = a + b, true if it doesn't fit
+constexpr bool add_overflow(int64_t a, int64_t b, int64_t &result) noexcept {
+#ifdef OM_TOOLS_OVERFLOW_BUILTINS
+    return __builtin_add_overflow(a, b, &result);
+#else
+    if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b)) {
+        return true;
+    }
+    result = a + b;
+    return false;
+#endif
+}
+
+// result = a - b, true if it doesn't fit
+constexpr bool sub_overflow(int64_t a, int64_t b, int64_t &result) noexcept {
+#ifdef OM_TOOLS_OVERFLOW_BUILTINS
+    return __builtin_sub_overflow(a, b, &result);
+#else
+    if ((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b)) {
+        return true;
+    }
+    result = a - b;
+    return false;
+#endif
+}
+
+// result = a * b, true if it doesn't fit
+constexpr bool mul_overflow(int64_t a, int64_t b, int64_t &result) noexcept {
+#ifdef OM_TOOLS_OVERFLOW_BUILTINS
+    return __builtin_mul_overflow(a, b, &result);
+#else
+    if (a != 0 && b != 0) {
+        // the bound the other one must stay within, by the signs
+        bool overflow = a > 0 ? (b > 0 ? a > INT64_MAX / b : b < INT64_MIN / a)
+                              : (b > 0 ? a < INT64_MIN / b : a < INT64_MAX / b);
+        if (overflow) {
+            return true;
+        }
+    }
+    result = a * b;
+    return false;
+#endif
+}
+
+// big endian, as PG sends binary values
+inline uint16_t read_uint16(const char *data) noexcept {
+    const auto *bytes = reinterpret_cast<const unsigned char *>(data);
+    return static_cast<uint16_t>(bytes[0] << 8 | bytes[1]);
+}
+
+}
+
+template<int SCALE>
+class Decimal {
+    static_assert(SCALE >= 0 && SCALE <= 18, "a Decimal has 18 digits, SCALE of them after the point");
+
+    int64_t m_units{0};
+
+    static constexpr int64_t add(int64_t a, int64_t b) {
+        int64_t result{};
+        if (decimal_detail::add_overflow(a, b, result)) {
+            throw std::overflow_error("Decimal overflow");
+        }
+        return result;
+    }
+
+    static constexpr int64_t subtract(int64_t a, int64_t b) {
+        int64_t result{};
+        if (decimal_detail::sub_overflow(a, b, result)) {
+            throw std::overflow_error("Decimal overflow");
+        }
+        return result;
+    }
+
+public:
+    static constexpr int scale = SCALE;
+    // units in 1, 100 for Decimal<2>
+    static constexpr int64_t one = static_cast<int64_t>(decimal_detail::pow10(SCALE));
+
+    constexpr Decimal() noexcept = default;
+
+    // a whole number, Decimal<2>(5) is 5.00
+    constexpr explicit Decimal(int64_t whole) : m_units(0) {
+        if (decimal_detail::mul_overflow(whole, one, m_units)) {
+            throw std::overflow_error("Decimal overflow");
+        }
+    }
+
+    // units of 10^-SCALE, from_units(1234) is 12.34 for Decimal<2>
+    static constexpr Decimal from_units(int64_t units) noexcept {
+        Decimal result;
+        result.m_units = units;
+        return result;
+    }
+
+    [[nodiscard]]
+    constexpr int64_t units() const noexcept { return m_units; }
+
+    // nearest double, for display and statistics, not for adding up
+    [[nodiscard]]
+    constexpr double to_double() const noexcept {
+        return static_cast<double>(m_units) / static_cast<double>(one);
+    }
+
+    /**
+     * Read a PG numeric in binary format, 8 bytes of header and base 10000 digits.
+     * Throws std::bad_cast if it is NaN, infinite, doesn't fit or isn't a numeric.
+     */
+    static Decimal from_pg_numeric(std::string_view bytes) {
+        using decimal_detail::read_uint16;
+        if (bytes.size() < 8) {
+            throw std::bad_cast();
+        }
+        const int ndigits = read_uint16(bytes.data());
+        const int weight = static_cast<int16_t>(read_uint16(bytes.data() + 2));
+        const uint16_t sign = read_uint16(bytes.data() + 4);
+        if ((sign != 0x0000 && sign != 0x4000) || bytes.size() != 8 + 2 * static_cast<size_t>(ndigits)) {
+            throw std::bad_cast();
+        }
+        // digit i is worth 10000^(weight - i), missing ones are 0
+        auto digit = [&](int i) -> unsigned {
+            return i >= 0 && i < ndigits ? read_uint16(bytes.data() + 8 + 2 * i) : 0;
+        };
+        for (int i = 0; i < ndigits; ++i) {
+            if (digit(i) > 9999) {
+                throw std::bad_cast();
+            }
+        }
+        decimal_detail::Accumulator<SCALE> accumulator;
+        for (int position = weight; position >= 0 && !accumulator.overflow; --position) {
+            unsigned group = digit(weight - position);
+            for (unsigned power = 1000; power; power /= 10) {
+                accumulator.integer_digit(group / power % 10);
+            }
+        }
+        // enough groups for SCALE digits and the one that rounds
+        for (int position = -1; accumulator.fraction_digits <= SCALE; --position) {
+            unsigned group = digit(weight - position);
+            for (unsigned power = 1000; power; power /= 10) {
+                accumulator.fraction_digit(group / power % 10);
+            }
+        }
+        Decimal result;
+        if (accumulator.finish(sign == 0x4000, result.m_units) != std::errc()) {
+            throw std::bad_cast();
+        }
+        return result;
+    }
+
+    /**
+     * Read a PG money in binary format, an int64 of cents, assuming the server's
+     * lc_monetary has 2 fraction digits, which most have.
+     * Throws std::bad_cast if it is the wrong size or doesn't fit.
+     */
+    static Decimal from_pg_money(std::string_view bytes) {
+        if (bytes.size() != 8) {
+            throw std::bad_cast();
+        }
+        uint64_t bits = 0;
+        for (char byte: bytes) {
+            bits = bits << 8 | static_cast<unsigned char>(byte);
+        }
+        auto cents = static_cast<int64_t>(bits);
+        Decimal result;
+        if constexpr (SCALE >= 2) {
+            if (decimal_detail::mul_overflow(cents, static_cast<int64_t>(decimal_detail::pow10(SCALE - 2)), result.m_units)) {
+                throw std::bad_cast();
+            }
+        } else {
+            constexpr auto divisor = static_cast<int64_t>(decimal_detail::pow10(2 - SCALE));
+            int64_t remainder = cents % divisor;
+            result.m_units = cents / divisor;
+            if (remainder >= divisor / 2) {
+                ++result.m_units;
+            } else if (-remainder >= divisor / 2) {
+                --result.m_units;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Read a Decimal at the start of [first, last), like std::from_chars, the end of it in ptr.
+     * An optional '-', '$' and ',' between whole digits for money, then digits, or digits
+     * with a point. invalid_argument if there is no number, result_out_of_range if it doesn't
+     * fit, value is unchanged then.
+     */
+    friend std::from_chars_result from_chars(const char *first, const char *last, Decimal &value) noexcept {
+        const char *next = first;
+        bool negative = false;
+        if (next != last && *next == '-') {
+            negative = true;
+            ++next;
+        }
+        bool money = false;
+        if (next != last && *next == '$') {
+            money = true;
+            ++next;
+        }
+        decimal_detail::Accumulator<SCALE> accumulator;
+        bool digits = false;
+        for (; next != last; ++next) {
+            if (*next >= '0' && *next <= '9') {
+                accumulator.integer_digit(static_cast<unsigned>(*next - '0'));
+                digits = true;
+            } else if (!(money && digits && *next == ',' && last - next > 1 && next[1] >= '0' && next[1] <= '9')) {
+                break;
+            }
+        }
+        if (next != last && *next == '.' && last - next > 1 && next[1] >= '0' && next[1] <= '9') {
+            for (++next; next != last && *next >= '0' && *next <= '9'; ++next) {
+                accumulator.fraction_digit(static_cast<unsigned>(*next - '0'));
+            }
+            digits = true;
+        }
+        if (!digits) {
+            return {first, std::errc::invalid_argument};
+        }
+        int64_t units = 0;
+        std::errc error = accumulator.finish(negative, units);
+        if (error == std::errc()) {
+            value.m_units = units;
+        }
+        return {next, error};
+    }
+
+    // "-1234.56", SCALE digits after the point, needs 21 + SCALE, errc::value_too_large if it doesn't fit
+    friend std::to_chars_result to_chars(char *first, char *last, const Decimal &value) noexcept {
+        uint64_t magnitude = value.m_units < 0 ? 0 - static_cast<uint64_t>(value.m_units)
+                                               : static_cast<uint64_t>(value.m_units);
+        char digits[20];
+        char *end = std::to_chars(digits, digits + sizeof digits, magnitude / static_cast<uint64_t>(one)).ptr;
+        auto size = static_cast<size_t>(end - digits) + (value.m_units < 0) + (SCALE ? SCALE + 1 : 0);
+        if (static_cast<size_t>(last - first) < size) {
+            return {last, std::errc::value_too_large};
+        }
+        char *out = first;
+        if (value.m_units < 0) {
+            *out++ = '-';
+        }
+        for (const char *digit = digits; digit != end; ++digit) {
+            *out++ = *digit;
+        }
+        if constexpr (SCALE > 0) {
+            *out++ = '.';
+            uint64_t fraction = magnitude % static_cast<uint64_t>(one);
+            for (int i = SCALE - 1; i >= 0; --i) {
+                out[i] = static_cast<char>('0' + fraction % 10);
+                fraction /= 10;
+            }
+            out += SCALE;
+        }
+        return {out, std::errc()};
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const Decimal &value) {
+        char buffer[40];
+        return os.write(buffer, to_chars(buffer, buffer + sizeof buffer, value).ptr - buffer);
+    }
+
+    // boost::lexical_cast needs this, lex_cast doesn't
+    friend std::istream &operator>>(std::istream &is, Decimal &value) {
+        std::string text;
+        if (is >> text) {
+            auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+            if (error != std::errc() || end != text.data() + text.size()) {
+                is.setstate(std::ios_base::failbit);
+            }
+        }
+        return is;
+    }
+
+    constexpr Decimal operator-() const { return from_units(subtract(0, m_units)); }
+
+    constexpr Decimal &operator+=(const Decimal &other) {
+        m_units = add(m_units, other.m_units);
+        return *this;
+    }
+
+    constexpr Decimal &operator-=(const Decimal &other) {
+        m_units = subtract(m_units, other.m_units);
+        return *this;
+    }
+
+    // a price times a quantity
+    constexpr Decimal &operator*=(int64_t factor) {
+        if (decimal_detail::mul_overflow(m_units, factor, m_units)) {
+            throw std::overflow_error("Decimal overflow");
+        }
+        return *this;
+    }
+
+    friend constexpr Decimal operator+(Decimal a, const Decimal &b) { return a += b; }
+
+    friend constexpr Decimal operator-(Decimal a, const Decimal &b) { return a -= b; }
+
+    friend constexpr Decimal operator*(Decimal a, int64_t factor) { return a *= factor; }
+
+    friend constexpr Decimal operator*(int64_t factor, Decimal a) { return a *= factor; }
+
+    friend constexpr bool operator==(const Decimal &a, const Decimal &b) noexcept { return a.m_units == b.m_units; }
+
+    friend constexpr bool operator!=(const Decimal &a, const Decimal &b) noexcept { return a.m_units != b.m_units; }
+
+    friend constexpr bool operator<(const Decimal &a, const Decimal &b) noexcept { return a.m_units < b.m_units; }
+
+    friend constexpr bool operator<=(const Decimal &a, const Decimal &b) noexcept { return a.m_units <= b.m_units; }
+
+    friend constexpr bool operator>(const Decimal &a, const Decimal &b) noexcept { return a.m_units > b.m_units; }
+
+    friend constexpr bool operator>=(const Decimal &a, const Decimal &b) noexcept { return a.m_units >= b.m_units; }
+};
+
+// cents, what a PG money holds
+using Money = Decimal<2>;
+
+template<typename T>
+struct is_decimal : std::false_type {};
+
+template<int SCALE>
+struct is_decimal<Decimal<SCALE>> : std::true_type {};
+
+#if __cplusplus >= 201103L
+}
+#endif
+}
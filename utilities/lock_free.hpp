@@ -0,0 +1,163 @@
+#pragma once
+
+/**
+ * Small lock-free building blocks, used by the connection pool.
+ *
+ * Index_stack is a Treiber stack of indexes into an array. The head holds an index
+ * and a tag that is bumped on every change, so an index that is popped and pushed
+ * back while another thread looks at it (ABA) fails that thread's CAS instead of
+ * corrupting the stack. Indexes into an array are never freed, so there is no
+ * memory reclamation problem either, and it all fits in a plain 64 bit CAS.
+ *
+ * Bounded_stack is a stack of values on top of two of those, one for the used
+ * slots and a free list.
+ *
+ * A preempted thread never blocks the others, every operation completes
+ * in a few instructions unless another thread succeeded in the meantime.
+ *
+ * It is bounded, push returns false when full and pop returns false when empty,
+ * the caller decides what to do about that.
+ *
+ * The head is read and changed sequentially consistent, a caller can then pair a push
+ * with a seq_cst flag of its own, like "someone is waiting", and know that either the
+ * waiter sees the pushed value or the pusher sees the flag. On x86 that costs nothing
+ * extra, a CAS is a full barrier anyway.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace om_tools::lock_free {
+#if __cplusplus >= 201103L
+inline namespace v1_0_0 {
+#endif
+
+// keep the hot heads on separate cache lines, or the pushing and popping threads
+// would invalidate each others cache line on every operation
+constexpr size_t cache_line_size = 64;
+
+/**
+ * Stack of the indexes 0 to capacity - 1, each index is in the stack at most once.
+ * The building block of the others, a free list of slots in an array for example.
+ */
+class Index_stack {
+public:
+    static constexpr uint32_t nil = UINT32_MAX;
+
+private:
+    // tag in the high half, index in the low half
+    static constexpr uint64_t pack(uint32_t index, uint32_t tag) {
+        return static_cast<uint64_t>(tag) << 32 | index;
+    }
+
+    static constexpr uint32_t index_of(uint64_t head) { return static_cast<uint32_t>(head); }
+
+    static constexpr uint32_t tag_of(uint64_t head) { return static_cast<uint32_t>(head >> 32); }
+
+    std::unique_ptr<std::atomic<uint32_t>[]> m_next;
+    alignas(cache_line_size) std::atomic<uint64_t> m_head{pack(nil, 0)};
+
+public:
+    /**
+     * @param capacity the indexes are 0 to capacity - 1
+     * @param full push them all, lowest index on top
+     */
+    explicit Index_stack(size_t capacity, bool full = false) : m_next(new std::atomic<uint32_t>[capacity]) {
+        for (size_t i = 0; i < capacity; ++i) {
+            m_next[i].store(nil, std::memory_order_relaxed);
+        }
+        if (full) {
+            for (size_t i = capacity; i > 0; --i) {
+                push(static_cast<uint32_t>(i - 1));
+            }
+        }
+    }
+
+    Index_stack(const Index_stack &) = delete;
+
+    Index_stack &operator=(const Index_stack &) = delete;
+
+    bool pop(uint32_t &index) noexcept {
+        uint64_t old_head = m_head.load();
+        for (;;) {
+            uint32_t top = index_of(old_head);
+            if (top == nil) {
+                return false;
+            }
+            uint32_t next = m_next[top].load(std::memory_order_relaxed);
+            if (m_head.compare_exchange_weak(old_head, pack(next, tag_of(old_head) + 1))) {
+                index = top;
+                return true;
+            }
+        }
+    }
+
+    void push(uint32_t index) noexcept {
+        uint64_t old_head = m_head.load(std::memory_order_relaxed);
+        do {
+            m_next[index].store(index_of(old_head), std::memory_order_relaxed);
+        } while (!m_head.compare_exchange_weak(old_head, pack(index, tag_of(old_head) + 1)));
+    }
+};
+
+template<class T>
+class Bounded_stack {
+    const size_t m_capacity;
+    std::unique_ptr<T[]> m_values;
+    Index_stack m_used;
+    Index_stack m_free;
+    alignas(cache_line_size) std::atomic<size_t> m_size{0};
+
+public:
+    explicit Bounded_stack(size_t capacity)
+        : m_capacity(capacity), m_values(new T[capacity]()), m_used(capacity), m_free(capacity, true) {}
+
+    Bounded_stack(const Bounded_stack &) = delete;
+
+    Bounded_stack &operator=(const Bounded_stack &) = delete;
+
+    /**
+     * Add to the top
+     * @return false if the stack is full
+     */
+    bool push(const T &value) noexcept {
+        uint32_t index = Index_stack::nil;
+        if (!m_free.pop(index)) {
+            return false;
+        }
+        m_values[index] = value;
+        // counted before it can be popped, or the size could go below zero for a moment
+        m_size.fetch_add(1, std::memory_order_relaxed);
+        m_used.push(index);
+        return true;
+    }
+
+    /**
+     * Take from the top, the most recently pushed
+     * @return false if the stack is empty
+     */
+    bool pop(T &value) noexcept {
+        uint32_t index = Index_stack::nil;
+        if (!m_used.pop(index)) {
+            return false;
+        }
+        value = m_values[index];
+        m_size.fetch_sub(1, std::memory_order_relaxed);
+        m_free.push(index);
+        return true;
+    }
+
+    // a snapshot, it may be stale before the caller gets to look at it
+    [[nodiscard]]
+    size_t size() const noexcept { return m_size.load(std::memory_order_relaxed); }
+
+    [[nodiscard]]
+    size_t capacity() const noexcept { return m_capacity; }
+};
+
+#if __cplusplus >= 201103L
+}
+#endif
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+/**
+ * Fixed size, contiguous storage for objects of one type, with a lock-free free list.
+ *
+ * Only memory, allocate() hands out an uninitialised slot and the caller constructs the
+ * object in it with placement new, destroys it and gives the slot back with deallocate().
+ * The slots are next to each other in one allocation, there is no allocator involved after
+ * construction and nothing to fragment when objects come and go.
+ *
+ * Usage:
+ *  Slab<Connection> slab(64);
+ *  void *slot = slab.allocate();   // nullptr when all slots are used
+ *  auto connection = new (slot) Connection(...);
+ *  ...
+ *  std::destroy_at(connection);
+ *  slab.deallocate(connection);
+ */
+
+#include "lock_free.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace om_tools::utilities {
+#if __cplusplus >= 201103L
+inline namespace v1_0_0 {
+#endif
+
+template<class T>
+class Slab {
+    struct Slot {
+        alignas(T) unsigned char bytes[sizeof(T)];
+    };
+
+    const size_t m_capacity;
+    std::unique_ptr<Slot[]> m_slots;
+    lock_free::Index_stack m_free;
+
+public:
+    explicit Slab(size_t capacity)
+        : m_capacity(capacity), m_slots(new Slot[capacity]), m_free(capacity, true) {}
+
+    Slab(const Slab &) = delete;
+
+    Slab &operator=(const Slab &) = delete;
+
+    /**
+     * @return an uninitialised slot, nullptr if all are in use
+     */
+    void *allocate() noexcept {
+        uint32_t index = 0;
+        if (m_free.pop(index)) {
+            return m_slots[index].bytes;
+        }
+        return nullptr;
+    }
+
+    // give back a slot from allocate(), the object in it must be destroyed already
+    void deallocate(void *slot) noexcept {
+        auto index = static_cast<uint32_t>(static_cast<Slot *>(slot) - m_slots.get());
+        m_free.push(index);
+    }
+
+    [[nodiscard]]
+    bool owns(const void *object) const noexcept {
+        // std::less, comparing with < is unspecified for pointers into different arrays
+        auto slot = static_cast<const Slot *>(object);
+        std::less<const Slot *> less;
+        return !less(slot, m_slots.get()) && less(slot, m_slots.get() + m_capacity);
+    }
+
+    [[nodiscard]]
+    size_t capacity() const noexcept { return m_capacity; }
+};
+
+#if __cplusplus >= 201103L
+}
+#endif
+}
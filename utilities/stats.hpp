@@ -0,0 +1,154 @@
+#pragma once
+
+/**
+ * Counters and histograms cheap enough to update on every call of a hot path.
+ *
+ * Each one is split in stripes on separate cache lines, a thread always updates the
+ * same stripe with a relaxed add, threads on different stripes never touch the same
+ * cache line. Reading sums the stripes without locks, the result is a snapshot that
+ * may be a few updates behind, which is fine for graphs and alerts.
+ *
+ * Usage:
+ *  Counter requests;
+ *  Histogram latency;
+ *  requests.add();
+ *  latency.record(std::chrono::steady_clock::now() - start);
+ *  ...
+ *  auto snapshot = latency.snapshot();
+ *  std::cout << requests.load() << ' ' << snapshot.percentile(0.99).count() << "ns\n";
+ */
+
+#include "lock_free.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace om_tools::stats {
+#if __cplusplus >= 201103L
+inline namespace v1_0_0 {
+#endif
+
+// number of stripes per counter, a power of 2
+constexpr size_t stripes = 8;
+
+// the stripe of the calling thread, handed out round robin as threads first use one
+inline size_t stripe() noexcept {
+    static std::atomic<size_t> next{0};
+    // constant initialised, no guard on every call like a dynamically initialised one
+    static thread_local size_t t_stripe = stripes;
+    if (t_stripe == stripes) {
+        t_stripe = next.fetch_add(1, std::memory_order_relaxed) & (stripes - 1);
+    }
+    return t_stripe;
+}
+
+// a sum, can go up and down, like number of connections in use
+class Counter {
+    struct alignas(lock_free::cache_line_size) Stripe {
+        std::atomic<int64_t> value{0};
+    };
+    std::array<Stripe, stripes> m_stripes;
+
+public:
+    void add(int64_t value = 1) noexcept {
+        m_stripes[stripe()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void sub(int64_t value = 1) noexcept { add(-value); }
+
+    [[nodiscard]]
+    int64_t load() const noexcept {
+        int64_t sum = 0;
+        for (const auto &stripe: m_stripes) {
+            sum += stripe.value.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+};
+
+// a Histogram read at one point in time
+struct Histogram_snapshot {
+    // bucket 0 is 0 and 1ns, bucket i is [2^i, 2^(i+1)) ns
+    static constexpr size_t bucket_count = 48;
+    std::array<uint64_t, bucket_count> buckets{};
+    uint64_t count{0};
+    std::chrono::nanoseconds sum{0};
+
+    [[nodiscard]]
+    std::chrono::nanoseconds mean() const noexcept {
+        return count ? sum / static_cast<int64_t>(count) : std::chrono::nanoseconds(0);
+    }
+
+    /**
+     * @param fraction 0.5 for the median, 0.99 for the 99th percentile
+     * @return upper bound of the bucket the percentile falls in, within a factor 2
+     */
+    [[nodiscard]]
+    std::chrono::nanoseconds percentile(double fraction) const noexcept {
+        auto rank = static_cast<uint64_t>(fraction * static_cast<double>(count));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucket_count; ++i) {
+            seen += buckets[i];
+            if (seen > rank) {
+                return std::chrono::nanoseconds((int64_t(1) << (i + 1)) - 1);
+            }
+        }
+        return std::chrono::nanoseconds(count ? (int64_t(1) << bucket_count) - 1 : 0);
+    }
+};
+
+// durations in power of 2 buckets, from nanoseconds to a few days
+class Histogram {
+    static constexpr size_t bucket_count = Histogram_snapshot::bucket_count;
+
+    struct alignas(lock_free::cache_line_size) Stripe {
+        std::array<std::atomic<uint64_t>, bucket_count> buckets{};
+        std::atomic<uint64_t> sum{0};
+    };
+    std::array<Stripe, stripes> m_stripes;
+
+    static size_t bucket(uint64_t ns) noexcept {
+#if defined(__GNUC__)
+        return std::min(size_t(63 - __builtin_clzll(ns | 1)), bucket_count - 1);
+#else
+        size_t index = 0;
+        while (ns > 1 && index < bucket_count - 1) {
+            ns >>= 1;
+            ++index;
+        }
+        return index;
+#endif
+    }
+
+public:
+    void record(std::chrono::nanoseconds duration) noexcept {
+        auto ns = static_cast<uint64_t>(std::max(duration.count(), int64_t(0)));
+        auto &stripe = m_stripes[stats::stripe()];
+        stripe.buckets[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        stripe.sum.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]]
+    Histogram_snapshot snapshot() const noexcept {
+        Histogram_snapshot snapshot;
+        uint64_t sum = 0;
+        for (const auto &stripe: m_stripes) {
+            for (size_t i = 0; i < bucket_count; ++i) {
+                auto count = stripe.buckets[i].load(std::memory_order_relaxed);
+                snapshot.buckets[i] += count;
+                snapshot.count += count;
+            }
+            sum += stripe.sum.load(std::memory_order_relaxed);
+        }
+        snapshot.sum = std::chrono::nanoseconds(sum);
+        return snapshot;
+    }
+};
+
+#if __cplusplus >= 201103L
+}
+#endif
+}
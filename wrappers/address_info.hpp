@@ -1,5 +1,6 @@
 #pragma once
 
+#include "resolver.hpp"
 #include <iostream>
 #include <memory>
 #include <optional>
@@ -9,13 +10,13 @@ namespace om_tools {
 #if __cplusplus >= 201103L
 inline namespace v1_0_0 {
 #endif
-// TODO this is not right, for TCP (AF_INET) the addrinfo is malloced by getaddrinfo but for UDS it's newed... fixit
-    // a bit surprised asan doesn't fail this
 
+// TCP addresses come from Resolver::instance(), shared with its cache and freed with
+// freeaddrinfo(), the one for UDS is made here and deleted, each by what allocated it
 class Addr_info {
-    using addrinfo_type = std::unique_ptr<addrinfo, decltype(&freeaddrinfo)>;
+    using addrinfo_type = std::shared_ptr<const addrinfo>;
 
-    addrinfo_type address{nullptr, freeaddrinfo};
+    addrinfo_type address;
 public:
 
     /**
@@ -36,16 +37,14 @@ public:
             hints->ai_flags = host.empty() ? AI_PASSIVE : 0; // fit for bind
             hints->ai_protocol = 0;
         }
-        addrinfo *result = nullptr;
-        if (hints->ai_family == AF_INET) {
-            if (int s = ::getaddrinfo(host.empty() ? nullptr : host.data(), port.data(),
-                                      &hints.value(), &result); s != 0) {
-                std::clog << "getaddrinfo: " << gai_strerror(s) << '\n';
-            } else {
-                address.reset(result);
+        if (hints->ai_family != AF_UNIX) {
+            auto resolution = Resolver::instance().resolve(host, port, hints.value());
+            if (!resolution) {
+                std::clog << "getaddrinfo: " << gai_strerror(resolution.error) << '\n';
             }
+            address = std::move(resolution.addresses);
         } else {
-            address.reset(new addrinfo(hints.value()));
+            address = std::make_shared<const addrinfo>(hints.value());
         }
         return address;
     }
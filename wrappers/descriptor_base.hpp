@@ -48,10 +48,15 @@ public:
     // cannot be copy assigned
     Descriptor_base &operator=(const Descriptor_base &other) = delete;
 
-    // can be move-assigned, the source will be invalidated
+    // can be move-assigned, the source will be invalidated, and this closed if valid
     Descriptor_base &operator=(Descriptor_base &&other) noexcept {
-        m_fd = other.m_fd;
-        other.m_fd = -1;
+        if (this != &other) {
+            if (valid()) {
+                close();
+            }
+            m_fd = other.m_fd;
+            other.m_fd = invalid_socket;
+        }
         return *this;
     }
 
@@ -0,0 +1,409 @@
+#pragma once
+
+/**
+ * An edge triggered epoll event loop, one thread serving tens of thousands of sockets,
+ * instead of a thread per client blocked in wait_request().
+ *
+ * The loop owns the Sockets added to it, they are made non-blocking and closed when
+ * removed or when the loop goes. A handler is called with the socket and the epoll
+ * events when there is something to do. Edge triggered means it is told once, so it
+ * must read, or write, until EAGAIN, or it won't be told again.
+ *
+ * A listening socket accepts with accept4(), a batch at a time, the clients come
+ * non-blocking to the accept handler, to add() them or not. When a batch was full the
+ * rest are accepted on the next turn of the loop, after the other sockets had theirs.
+ *
+ * Timers run on the loop's thread, after() once and every() until cancelled.
+ * Handlers and timers may add and remove sockets and timers, themselves included.
+ * Only stop() may be called from other threads.
+ *
+ * Usage:
+ *  Event_loop loop;
+ *  loop.listen(Socket::create_uds_server_socket("echo.sock"), [&loop](Socket client) {
+ *      loop.add(std::move(client), Event_loop::readable, [&loop](Socket &socket, uint32_t events) {
+ *          char buffer[4096];
+ *          ssize_t size;
+ *          while ((size = ::read(socket.get(), buffer, sizeof buffer)) > 0) {
+ *              ::write(socket.get(), buffer, size);
+ *          }
+ *          if (size == 0 || (events & Event_loop::hung_up)) {
+ *              loop.remove(socket.get());
+ *          }
+ *      });
+ *  });
+ *  loop.every(std::chrono::seconds(10), [&loop] { std::clog << loop.size() << " sockets\n"; });
+ *  loop.run();
+ */
+
+#include "descriptor_base.hpp"
+#include "ip_socket.hpp"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+namespace om_tools {
+namespace descriptors {
+
+#if __cplusplus >= 201103L
+inline namespace v1_0_0 {
+#endif
+
+class Event_loop {
+public:
+    // interest and events
+    static constexpr uint32_t readable = EPOLLIN | EPOLLRDHUP;
+    static constexpr uint32_t writable = EPOLLOUT;
+    // the peer closed or the socket failed, comes with readable, and even without interest
+    static constexpr uint32_t hung_up = EPOLLRDHUP | EPOLLHUP | EPOLLERR;
+
+    using clock = std::chrono::steady_clock;
+    using Handler = std::function<void(Socket &socket, uint32_t events)>;
+    using Accept_handler = std::function<void(Socket client)>;
+    using Timer_id = uint64_t;
+
+private:
+    struct Entry {
+        Socket socket;
+        Handler handler;
+        // only listeners have one
+        Accept_handler on_accept;
+        size_t accept_batch{0};
+        uint32_t generation{0};
+    };
+
+    struct Timer {
+        clock::time_point deadline;
+        Timer_id id;
+
+        bool operator>(const Timer &other) const { return deadline > other.deadline; }
+    };
+
+    struct Timer_task {
+        std::function<void()> callback;
+        // zero for once
+        clock::duration interval;
+    };
+
+    // epoll data is the fd and the generation of its entry, an event for a socket removed
+    // by an earlier handler, or for a new one that got the same fd, is recognised and dropped
+    static constexpr uint64_t wake_key = ~uint64_t(0);
+
+    Descriptor_base<int32_t> m_epoll;
+    // eventfd that stop() writes to
+    Descriptor_base<int32_t> m_wake;
+    std::vector<epoll_event> m_events;
+    // by fd
+    std::vector<std::unique_ptr<Entry>> m_entries;
+    // removed during a turn, destroyed after it, a handler may be removing itself
+    std::vector<std::unique_ptr<Entry>> m_removed;
+    // listeners that filled a batch, accepted again next turn
+    std::vector<uint64_t> m_backlog;
+    std::vector<uint64_t> m_accepting;
+    size_t m_size{0};
+    uint32_t m_generation{0};
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<>> m_timers;
+    std::unordered_map<Timer_id, Timer_task> m_timer_tasks;
+    Timer_id m_next_timer{0};
+    std::atomic<bool> m_stop{false};
+
+    static uint64_t key(int32_t fd, uint32_t generation) {
+        return uint64_t(generation) << 32 | uint32_t(fd);
+    }
+
+    // the entry key is for, or null if it has gone
+    Entry *find(uint64_t key) const {
+        auto fd = static_cast<size_t>(key & 0xffffffff);
+        if (fd < m_entries.size() && m_entries[fd] && m_entries[fd]->generation == key >> 32) {
+            return m_entries[fd].get();
+        }
+        return nullptr;
+    }
+
+    void control(int operation, int32_t fd, uint32_t interest, uint64_t data) const {
+        epoll_event event{};
+        event.events = interest;
+        event.data.u64 = data;
+        if (::epoll_ctl(m_epoll.get(), operation, fd, &event) == -1) {
+            throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+        }
+    }
+
+    static void set_non_blocking(int32_t fd) {
+        int flags = ::fcntl(fd, F_GETFL);
+        if (flags == -1 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+            throw std::system_error(errno, std::generic_category(), "fcntl");
+        }
+    }
+
+    // up to a batch of clients, the listener goes in the backlog if there may be more
+    void accept_batch(Entry &listener) {
+        const int32_t fd = listener.socket.get();
+        for (size_t accepted = 0; accepted < listener.accept_batch; ++accepted) {
+            int32_t client = ::accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (client == -1) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                // out of descriptors leaves the rest in the queue until the next client arrives
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    std::clog << __FUNCTION__ << ": accept4 failed: " << strerror(errno) << '\n';
+                }
+                return;
+            }
+            listener.on_accept(Socket(client));
+            if (find(key(fd, listener.generation)) != &listener) {
+                // the accept handler removed it
+                return;
+            }
+        }
+        m_backlog.push_back(key(fd, listener.generation));
+    }
+
+    // the ones that are due, returns how many ran
+    size_t run_timers() {
+        size_t ran = 0;
+        const auto now = clock::now();
+        while (!m_timers.empty() && m_timers.top().deadline <= now) {
+            Timer timer = m_timers.top();
+            m_timers.pop();
+            auto task = m_timer_tasks.find(timer.id);
+            if (task == m_timer_tasks.end()) {
+                // cancelled
+                continue;
+            }
+            ++ran;
+            // out of the map while it runs, it may cancel itself or add others
+            Timer_task running = std::move(task->second);
+            if (running.interval == clock::duration::zero()) {
+                m_timer_tasks.erase(task);
+                running.callback();
+                continue;
+            }
+            running.callback();
+            if (auto again = m_timer_tasks.find(timer.id); again != m_timer_tasks.end()) {
+                again->second.callback = std::move(running.callback);
+                auto next = timer.deadline + running.interval;
+                if (next <= now) {
+                    // fallen behind, a blocking handler perhaps, don't catch up in a burst
+                    next = now + running.interval;
+                }
+                m_timers.push({next, timer.id});
+            }
+        }
+        return ran;
+    }
+
+    // milliseconds epoll_wait may block, rounded up, -1 is forever
+    int wait_time(clock::duration max_wait) const {
+        if (!m_backlog.empty()) {
+            return 0;
+        }
+        if (!m_timers.empty()) {
+            max_wait = std::min(max_wait, std::max(m_timers.top().deadline - clock::now(), clock::duration::zero()));
+        }
+        if (max_wait == clock::duration::max()) {
+            return -1;
+        }
+        auto millis = std::chrono::ceil<std::chrono::milliseconds>(max_wait).count();
+        return static_cast<int>(std::min<decltype(millis)>(millis, INT_MAX));
+    }
+
+public:
+    /**
+     * @param max_events most events handled per epoll_wait
+     * throws std::system_error if epoll or the eventfd can't be created
+     */
+    explicit Event_loop(size_t max_events = 256)
+        : m_epoll(::epoll_create1(EPOLL_CLOEXEC)),
+          m_wake(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+          m_events(std::max<size_t>(max_events, 1)) {
+        if (!m_epoll.valid() || !m_wake.valid()) {
+            throw std::system_error(errno, std::generic_category(), "Event_loop");
+        }
+        control(EPOLL_CTL_ADD, m_wake.get(), EPOLLIN, wake_key);
+    }
+
+    Event_loop(const Event_loop &) = delete;
+
+    Event_loop &operator=(const Event_loop &) = delete;
+
+    /**
+     * Own socket and call handler when it is ready for interest, readable, writable or both.
+     * throws std::system_error if it can't be added, socket is closed then
+     * @return the socket, where the loop keeps it, until it is removed
+     */
+    Socket &add(Socket socket, uint32_t interest, Handler handler) {
+        if (!socket.valid()) {
+            throw std::invalid_argument("Event_loop::add invalid socket");
+        }
+        const int32_t fd = socket.get();
+        set_non_blocking(fd);
+        auto entry = std::make_unique<Entry>();
+        entry->socket = std::move(socket);
+        entry->handler = std::move(handler);
+        entry->generation = ++m_generation;
+        control(EPOLL_CTL_ADD, fd, interest | EPOLLET, key(fd, entry->generation));
+        if (static_cast<size_t>(fd) >= m_entries.size()) {
+            m_entries.resize(static_cast<size_t>(fd) + 1);
+        }
+        m_entries[static_cast<size_t>(fd)] = std::move(entry);
+        ++m_size;
+        return m_entries[static_cast<size_t>(fd)]->socket;
+    }
+
+    /**
+     * Own a listening socket and give each client to on_accept, non-blocking.
+     * @param batch most clients accepted in a row before the other sockets get a turn
+     */
+    Socket &listen(Socket server, Accept_handler on_accept, size_t batch = 64) {
+        Socket &socket = add(std::move(server), readable, nullptr);
+        auto &entry = *m_entries[static_cast<size_t>(socket.get())];
+        entry.on_accept = std::move(on_accept);
+        entry.accept_batch = std::max<size_t>(batch, 1);
+        // the ones that connected before it was added, no edge for those
+        m_backlog.push_back(key(socket.get(), entry.generation));
+        return socket;
+    }
+
+    // change the interest of a socket in the loop, readable, writable or both
+    void modify(int32_t fd, uint32_t interest) {
+        if (static_cast<size_t>(fd) < m_entries.size() && m_entries[static_cast<size_t>(fd)]) {
+            control(EPOLL_CTL_MOD, fd, interest | EPOLLET, key(fd, m_entries[static_cast<size_t>(fd)]->generation));
+        }
+    }
+
+    // remove and close, at the end of the turn, the handler may still be using it
+    void remove(int32_t fd) {
+        if (static_cast<size_t>(fd) >= m_entries.size() || !m_entries[static_cast<size_t>(fd)]) {
+            return;
+        }
+        ::epoll_ctl(m_epoll.get(), EPOLL_CTL_DEL, fd, nullptr);
+        m_removed.push_back(std::move(m_entries[static_cast<size_t>(fd)]));
+        --m_size;
+    }
+
+    // take the socket back, not closed, invalid if it wasn't in the loop
+    Socket release(int32_t fd) {
+        if (static_cast<size_t>(fd) >= m_entries.size() || !m_entries[static_cast<size_t>(fd)]) {
+            return {};
+        }
+        Socket socket(std::move(m_entries[static_cast<size_t>(fd)]->socket));
+        remove(fd);
+        return socket;
+    }
+
+    // sockets in the loop, listeners included
+    [[nodiscard]]
+    size_t size() const noexcept { return m_size; }
+
+    // call callback once, after delay
+    Timer_id after(clock::duration delay, std::function<void()> callback) {
+        Timer_id id = ++m_next_timer;
+        m_timer_tasks.emplace(id, Timer_task{std::move(callback), clock::duration::zero()});
+        m_timers.push({clock::now() + delay, id});
+        return id;
+    }
+
+    // call callback every interval, until cancelled
+    Timer_id every(clock::duration interval, std::function<void()> callback) {
+        Timer_id id = ++m_next_timer;
+        interval = std::max(interval, clock::duration(1));
+        m_timer_tasks.emplace(id, Timer_task{std::move(callback), interval});
+        m_timers.push({clock::now() + interval, id});
+        return id;
+    }
+
+    // false if it already ran, or was cancelled
+    bool cancel(Timer_id id) {
+        return m_timer_tasks.erase(id) != 0;
+    }
+
+    /**
+     * Wait for events, up to max_wait or the next timer, and handle them.
+     * throws std::system_error if epoll_wait fails, and whatever a handler throws
+     * @return the number of handlers and timers called
+     */
+    size_t run_once(clock::duration max_wait = clock::duration::max()) {
+        int count = ::epoll_wait(m_epoll.get(), m_events.data(), static_cast<int>(m_events.size()),
+                                 wait_time(max_wait));
+        if (count == -1) {
+            if (errno != EINTR) {
+                throw std::system_error(errno, std::generic_category(), "epoll_wait");
+            }
+            count = 0;
+        }
+        size_t handled = 0;
+        m_accepting.swap(m_backlog);
+        for (uint64_t listener: m_accepting) {
+            if (Entry *entry = find(listener)) {
+                accept_batch(*entry);
+                ++handled;
+            }
+        }
+        m_accepting.clear();
+        for (int i = 0; i < count; ++i) {
+            const epoll_event &event = m_events[static_cast<size_t>(i)];
+            if (event.data.u64 == wake_key) {
+                uint64_t value;
+                while (::read(m_wake.get(), &value, sizeof value) > 0) {}
+                continue;
+            }
+            Entry *entry = find(event.data.u64);
+            if (!entry) {
+                continue;
+            }
+            if (entry->on_accept) {
+                // in the backlog already if it filled a batch on the way here
+                if (std::find(m_backlog.begin(), m_backlog.end(), event.data.u64) == m_backlog.end()) {
+                    accept_batch(*entry);
+                }
+            } else {
+                entry->handler(entry->socket, event.events);
+            }
+            ++handled;
+        }
+        handled += run_timers();
+        m_removed.clear();
+        return handled;
+    }
+
+    // handle events until stop()
+    void run() {
+        while (!m_stop.load(std::memory_order_acquire)) {
+            run_once();
+        }
+        m_stop.store(false, std::memory_order_relaxed);
+    }
+
+    // make run() return after the current turn, from any thread
+    void stop() noexcept {
+        m_stop.store(true, std::memory_order_release);
+        uint64_t one = 1;
+        [[maybe_unused]] auto written = ::write(m_wake.get(), &one, sizeof one);
+    }
+};
+
+#if __cplusplus >= 201103L
+}
+#endif
+
+}
+using descriptors::Event_loop;
+}
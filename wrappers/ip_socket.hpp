@@ -8,7 +8,16 @@
 #include <memory>
 #include <string_view>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
 #include <cstring>
+#include <system_error>
+#include <vector>
 
 
 namespace om_tools {
@@ -18,6 +27,65 @@ namespace descriptors {
 inline namespace v1_0_0 {
 #endif
 
+struct Connected;
+
+struct Keep_alive {
+    // quiet this long before the first probe
+    std::chrono::seconds idle{60};
+    std::chrono::seconds interval{10};
+    // unanswered probes before the connection is dropped
+    int count{5};
+};
+
+/**
+ * Socket options to set together, at creation. Only the ones that are set are set, TCP
+ * ones are left out for unix sockets. Listeners pass most of them on to the clients they
+ * accept, Server sets them on both.
+ */
+struct Socket_profile {
+    std::optional<bool> no_delay;
+    std::optional<bool> quick_ack;
+    std::optional<int> receive_buffer;
+    std::optional<int> send_buffer;
+    std::optional<std::chrono::microseconds> busy_poll;
+    std::optional<std::chrono::milliseconds> user_timeout;
+    std::optional<Keep_alive> keep_alive;
+    std::optional<int> incoming_cpu;
+
+    // small requests and answers, every microsecond counts, a dead peer is noticed in seconds
+    static Socket_profile low_latency_rpc() {
+        Socket_profile profile;
+        profile.no_delay = true;
+        profile.quick_ack = true;
+        profile.busy_poll = std::chrono::microseconds(50);
+        profile.user_timeout = std::chrono::seconds(10);
+        profile.keep_alive = Keep_alive{std::chrono::seconds(30), std::chrono::seconds(5), 3};
+        return profile;
+    }
+
+    // large transfers, big buffers for a full window on long fat links, patient with slow peers
+    static Socket_profile bulk_transfer() {
+        Socket_profile profile;
+        profile.no_delay = false;
+        profile.receive_buffer = 4 << 20;
+        profile.send_buffer = 4 << 20;
+        profile.keep_alive = Keep_alive{};
+        return profile;
+    }
+};
+
+// how Socket::connect_tcp() tries the addresses of a host
+struct Connect_options {
+    // each address gets this long to connect
+    std::chrono::milliseconds attempt_timeout{5000};
+    // the next address is tried after this long, or as soon as the one before fails, RFC 8305 says 250ms
+    std::chrono::milliseconds stagger{250};
+    // leave the socket non-blocking, for an Event_loop
+    bool non_blocking{false};
+    // set before connecting, buffer sizes must be
+    Socket_profile profile;
+};
+
 /**
 * a socket descriptor
 */
@@ -32,16 +100,118 @@ public:
     [[nodiscard]]
     Socket wait_request() const;
 
-    static Socket create_server_socket(std::string_view name, std::string_view port);
+    static Socket create_server_socket(std::string_view name, std::string_view port, bool reuse_port = false,
+                                       const Socket_profile &profile = {});
 //    static IP_socket create_client_socket(std::string_view host, std::string_view port);
 
-    static Socket create_tcp_server_socket(std::string_view port);
+    // reuse_port for one listener per thread on the same port, the kernel spreads the clients
+    static Socket create_tcp_server_socket(std::string_view port, bool reuse_port = false,
+                                           const Socket_profile &profile = {});
     static Socket create_tcp_client_socket(std::string_view host, std::string_view port);
 
+    /**
+     * Connect to host, racing its addresses Happy Eyeballs style, RFC 8305. IPv6 and IPv4
+     * addresses take turns, a new attempt starts every stagger until one connects, each
+     * non-blocking with its own deadline. An address that doesn't answer costs stagger,
+     * not the minutes of the kernel's SYN retries.
+     * @return the first socket to connect, how long it took, or why none did
+     */
+    static Connected connect_tcp(std::string_view host, std::string_view port, const Connect_options &options = {});
+
+    // race addresses, a getaddrinfo() list, in the order given
+    static Connected connect_tcp(const addrinfo *addresses, const Connect_options &options = {});
+
     static Socket create_uds_server_socket(std::string_view name);
     static Socket create_uds_client_socket(std::string_view name);
+
+    // options, chainable, socket.no_delay().keep_alive({}), throw std::system_error if refused
+
+    // send small writes right away, no Nagle
+    Socket &no_delay(bool on = true) { return option(IPPROTO_TCP, TCP_NODELAY, on); }
+
+    // ack right away instead of waiting for an answer to piggyback on, Linux turns it
+    // back off by itself now and then, so set it after reads that matter
+    Socket &quick_ack(bool on = true) { return option(IPPROTO_TCP, TCP_QUICKACK, on); }
+
+    // the kernel doubles these, and caps them at net.core.rmem_max and wmem_max
+    Socket &receive_buffer(int bytes) { return option(SOL_SOCKET, SO_RCVBUF, bytes); }
+
+    Socket &send_buffer(int bytes) { return option(SOL_SOCKET, SO_SNDBUF, bytes); }
+
+    // spin on the device queue this long in a blocking read, more than net.core.busy_read needs CAP_NET_ADMIN
+    Socket &busy_poll(std::chrono::microseconds time) {
+        return option(SOL_SOCKET, SO_BUSY_POLL, static_cast<int>(time.count()));
+    }
+
+    // give up on a peer that doesn't ack sent data for this long, 0 is the kernel's default
+    Socket &user_timeout(std::chrono::milliseconds time) {
+        return option(IPPROTO_TCP, TCP_USER_TIMEOUT, static_cast<int>(time.count()));
+    }
+
+    Socket &keep_alive(const Keep_alive &probes) {
+        return option(SOL_SOCKET, SO_KEEPALIVE, 1)
+            .option(IPPROTO_TCP, TCP_KEEPIDLE, static_cast<int>(probes.idle.count()))
+            .option(IPPROTO_TCP, TCP_KEEPINTVL, static_cast<int>(probes.interval.count()))
+            .option(IPPROTO_TCP, TCP_KEEPCNT, probes.count);
+    }
+
+    // a listener in a SO_REUSEPORT group that prefers clients arriving on cpu
+    Socket &incoming_cpu(int cpu) { return option(SOL_SOCKET, SO_INCOMING_CPU, cpu); }
+
+    // any other int option
+    Socket &option(int level, int name, int value) {
+        if (::setsockopt(get(), level, name, &value, sizeof value) == -1) {
+            throw std::system_error(errno, std::generic_category(), "setsockopt");
+        }
+        return *this;
+    }
+
+    /**
+     * Set the options profile has, the TCP ones only on TCP sockets. Unlike the setters it
+     * doesn't throw, an option that is refused is logged and the rest are set anyway.
+     * @return false if one was refused
+     */
+    bool apply(const Socket_profile &profile) noexcept;
 };
 
+struct Connected {
+    Socket socket;
+    // getaddrinfo()
+    std::chrono::steady_clock::duration resolve_time{};
+    // from the first attempt until connected
+    std::chrono::steady_clock::duration latency{};
+    // the last attempt's, if none connected, timed_out if it ran out of time
+    std::error_code error;
+
+    explicit operator bool() const { return socket.valid(); }
+};
+
+inline bool Socket::apply(const Socket_profile &profile) noexcept {
+    int protocol = 0;
+    socklen_t length = sizeof protocol;
+    const bool tcp = ::getsockopt(get(), SOL_SOCKET, SO_PROTOCOL, &protocol, &length) == 0 && protocol == IPPROTO_TCP;
+    bool applied = true;
+    auto try_set = [&applied](const char *name, auto &&setter) {
+        try {
+            setter();
+        } catch (const std::system_error &e) {
+            std::clog << "Socket::apply: " << name << " failed: " << e.code().message() << '\n';
+            applied = false;
+        }
+    };
+    if (profile.receive_buffer) try_set("SO_RCVBUF", [&] { receive_buffer(*profile.receive_buffer); });
+    if (profile.send_buffer) try_set("SO_SNDBUF", [&] { send_buffer(*profile.send_buffer); });
+    if (profile.busy_poll) try_set("SO_BUSY_POLL", [&] { busy_poll(*profile.busy_poll); });
+    if (profile.incoming_cpu) try_set("SO_INCOMING_CPU", [&] { incoming_cpu(*profile.incoming_cpu); });
+    if (tcp) {
+        if (profile.no_delay) try_set("TCP_NODELAY", [&] { no_delay(*profile.no_delay); });
+        if (profile.quick_ack) try_set("TCP_QUICKACK", [&] { quick_ack(*profile.quick_ack); });
+        if (profile.user_timeout) try_set("TCP_USER_TIMEOUT", [&] { user_timeout(*profile.user_timeout); });
+        if (profile.keep_alive) try_set("keep alive", [&] { keep_alive(*profile.keep_alive); });
+    }
+    return applied;
+}
+
 /**
 * Server socket creates a client socket
 * @return the accepted client socket
@@ -91,8 +261,8 @@ inline void Socket::wait_request(const Socket &server_socket) {
  * @param port to bind and listen to
  * @return a socket_fd
  */
-inline Socket Socket::create_tcp_server_socket(std::string_view  port) {
-    return create_server_socket("", port);
+inline Socket Socket::create_tcp_server_socket(std::string_view  port, bool reuse_port, const Socket_profile &profile) {
+    return create_server_socket("", port, reuse_port, profile);
 //    Addr_info address;
 //    auto &address_info = address.getaddrinfo("", port.data());
 //
@@ -165,9 +335,12 @@ inline Socket Socket::create_uds_server_socket(std::string_view name) {
  * the socket_fd is size of int usually so dont worrying about return value optimization
  *
  * @param port to bind and listen to
+ * @param reuse_port SO_REUSEPORT, TCP only
+ * @param profile options set before listen(), the clients inherit most
  * @return a socket_fd
  */
-inline Socket Socket::create_server_socket(std::string_view name, std::string_view port) {
+inline Socket Socket::create_server_socket(std::string_view name, std::string_view port, bool reuse_port,
+                                           const Socket_profile &profile) {
 
     Addr_info address;
     // if port is empty, we want udp, i.e. name is a filename
@@ -185,6 +358,12 @@ inline Socket Socket::create_server_socket(std::string_view name, std::string_vi
         return {};
     }
 
+    if (reuse_port && setsockopt(sock.get(), SOL_SOCKET, SO_REUSEPORT, &opt_val, sizeof opt_val) != 0) {
+        std::clog << __FUNCTION__ << ": setsockopt SO_REUSEPORT failed: " << strerror(errno);
+        return {};
+    }
+    sock.apply(profile);
+
     Sockaddr sockaddr(name, port);
     const auto [addr, sock_len] = sockaddr.get_sockaddr();
     if (bind(sock.get(), addr, sock_len) == -1) {
@@ -200,34 +379,142 @@ inline Socket Socket::create_server_socket(std::string_view name, std::string_vi
     return sock;
 }
 
-Socket Socket::create_tcp_client_socket(std::string_view host, std::string_view  port) {
+inline Socket Socket::create_tcp_client_socket(std::string_view host, std::string_view  port) {
+    Connected connected = connect_tcp(host, port);
+    if (!connected) {
+        std::clog << "Could not connect: " << connected.error.message() << '\n';
+    }
+    return std::move(connected.socket);
+}
 
+inline Connected Socket::connect_tcp(std::string_view host, std::string_view port, const Connect_options &options) {
+    const auto start = std::chrono::steady_clock::now();
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
     Addr_info address;
-    auto &result = address.getaddrinfo(host.data(), port.data());
+    auto &addresses = address.getaddrinfo(host, port, hints);
+    const auto resolve_time = std::chrono::steady_clock::now() - start;
+    if (!addresses) {
+        Connected failed;
+        failed.resolve_time = resolve_time;
+        failed.error = std::make_error_code(std::errc::host_unreachable);
+        return failed;
+    }
+    Connected connected = connect_tcp(addresses.get(), options);
+    connected.resolve_time = resolve_time;
+    return connected;
+}
+
+inline Connected Socket::connect_tcp(const addrinfo *addresses, const Connect_options &options) {
+    using clock = std::chrono::steady_clock;
+    Connected result;
+    result.error = std::make_error_code(std::errc::host_unreachable);
+
+    // the families take turns, starting with the first one's
+    std::vector<const addrinfo *> first_family, other_family, candidates;
+    for (const addrinfo *rp = addresses; rp != nullptr; rp = rp->ai_next) {
+        (rp->ai_family == addresses->ai_family ? first_family : other_family).push_back(rp);
+    }
+    for (size_t i = 0; i < std::max(first_family.size(), other_family.size()); ++i) {
+        if (i < first_family.size()) candidates.push_back(first_family[i]);
+        if (i < other_family.size()) candidates.push_back(other_family[i]);
+    }
 
-    Socket client_socket;
-    for (addrinfo *rp = result.get(); rp != nullptr; rp = rp->ai_next) {
-        client_socket.set(socket(rp->ai_family, rp->ai_socktype,
-                                 rp->ai_protocol));
-        if (!client_socket.valid()) {
+    // attempts[i] is polled with polls[i]
+    std::vector<std::pair<Socket, clock::time_point>> attempts;
+    std::vector<pollfd> polls;
+    auto drop = [&](size_t i, std::error_code error) {
+        result.error = error;
+        std::swap(attempts[i], attempts.back());
+        std::swap(polls[i], polls.back());
+        attempts.pop_back();
+        polls.pop_back();
+    };
+
+    const auto start = clock::now();
+    auto next_start = start;
+    size_t next = 0;
+    Socket winner;
+    while (!winner.valid()) {
+        auto now = clock::now();
+        if (next < candidates.size() && (now >= next_start || attempts.empty())) {
+            const addrinfo *candidate = candidates[next++];
+            next_start = now + options.stagger;
+            Socket attempt(::socket(candidate->ai_family, candidate->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                                    candidate->ai_protocol));
+            if (!attempt.valid()) {
+                result.error = std::error_code(errno, std::generic_category());
+                next_start = now;
+                continue;
+            }
+            attempt.apply(options.profile);
+            if (::connect(attempt.get(), candidate->ai_addr, candidate->ai_addrlen) == 0) {
+                winner = std::move(attempt);
+            } else if (errno == EINPROGRESS) {
+                polls.push_back({attempt.get(), POLLOUT, 0});
+                attempts.emplace_back(std::move(attempt), now + options.attempt_timeout);
+            } else {
+                // refused or unreachable right away, on to the next
+                result.error = std::error_code(errno, std::generic_category());
+                next_start = now;
+            }
             continue;
         }
-        if (int res = connect(client_socket.get(), rp->ai_addr, rp->ai_addrlen); res != -1) {
-            break;                  /* Success */
+        if (attempts.empty()) {
+            break;
         }
-        if (rp->ai_next == nullptr) {
-            std::clog << "Could not connect\n";
-            return {};
+        auto wake = next < candidates.size() ? next_start : clock::time_point::max();
+        for (size_t i = attempts.size(); i-- > 0;) {
+            if (attempts[i].second <= now) {
+                drop(i, std::make_error_code(std::errc::timed_out));
+            } else {
+                wake = std::min(wake, attempts[i].second);
+            }
+        }
+        if (attempts.empty()) {
+            continue;
+        }
+        auto wait = std::chrono::ceil<std::chrono::milliseconds>(wake - now).count();
+        int ready = ::poll(polls.data(), polls.size(), static_cast<int>(std::min<decltype(wait)>(wait, 60000)));
+        if (ready == -1 && errno != EINTR) {
+            result.error = std::error_code(errno, std::generic_category());
+            break;
+        }
+        for (size_t i = polls.size(); ready > 0 && i-- > 0;) {
+            if (polls[i].revents == 0) {
+                continue;
+            }
+            int error = 0;
+            socklen_t length = sizeof error;
+            if (::getsockopt(polls[i].fd, SOL_SOCKET, SO_ERROR, &error, &length) == -1) {
+                error = errno;
+            }
+            if (error == 0) {
+                winner = std::move(attempts[i].first);
+                break;
+            }
+            drop(i, std::error_code(error, std::generic_category()));
         }
     }
 
-    return client_socket;
+    if (winner.valid()) {
+        result.latency = clock::now() - start;
+        result.error.clear();
+        if (!options.non_blocking) {
+            ::fcntl(winner.get(), F_SETFL, ::fcntl(winner.get(), F_GETFL) & ~O_NONBLOCK);
+        }
+        result.socket = std::move(winner);
+    }
+    // the other attempts are closed here
+    return result;
 }
 
 Socket Socket::create_uds_client_socket(std::string_view name) {
 
     Socket client(socket(AF_UNIX, SOCK_STREAM, 0));
     struct sockaddr_un     server_address{};
+    server_address.sun_family = AF_UNIX;
     name.copy(server_address.sun_path, name.size());
     int32_t connect_rc = connect(client.get(), reinterpret_cast<struct sockaddr*> (&server_address), sizeof server_address);
     if (connect_rc == -1) {
@@ -4,7 +4,8 @@
  *
  * All text transfer for simplicity. For binary transfer, you need a bigger boat, there
  * are plenty around but most require newer C++.
- * Values are translated to and from required types.
+ * Values are translated to and from required types. Decimal, for numeric and money,
+ * is read from binary too, if the result is binary.
  *
  * Call is done with connection().exec() that returns a PGresult pointer. Catch it with the
  * scoped_result class to validate the result and to retrieve field values with
@@ -38,7 +39,11 @@
 
 #endif
 
+#include "algorithm.h"
+#include "decimal.hpp"
 #include <iostream>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 // stop linters complaining about NULL for pre C++11 standards
@@ -187,11 +192,27 @@ public:
         return PQnfields(result);
     }
 
+    // the field converted to T, a Decimal is read without a stream, in text or binary
+    template<typename T>
+    static T convert(PGresult *result, int32_t row, int32_t column) {
+        if constexpr (utilities::is_decimal<T>::value) {
+            if (PQfformat(result, column) == 1) {
+                std::string_view bytes(PQgetvalue(result, row, column),
+                                       static_cast<size_t>(PQgetlength(result, row, column)));
+                // 790 is money, CASHOID in pg_type.h
+                return PQftype(result, column) == 790 ? T::from_pg_money(bytes) : T::from_pg_numeric(bytes);
+            }
+            return utilities::lex_cast<T>(PQgetvalue(result, row, column));
+        } else {
+            return boost::lexical_cast<T>(PQgetvalue(result, row, column));
+        }
+    }
+
     // get the converted value
     template<typename T>
     T get_value(int32_t row, int32_t column) const {
         if (0 < get_rows() && row < get_rows() && column < get_columns()) {
-            return boost::lexical_cast<T>(get_string_value(row, column));
+            return convert<T>(result, row, column);
         }
         return T();
     }
@@ -236,7 +257,7 @@ public:
         template<class T>
         T get(int32_t column) {
             if (column < res.get_columns()) {
-                return boost::lexical_cast<T>(res.get_string_value(row_num, column));
+                return convert<T>(res.result, row_num, column);
             }
             return T();
         }
@@ -271,33 +292,45 @@ void Scoped_result::list_tuples() const NOEXCEPT {
     }
 }
 
+// the parameter values as text, formatted with lex_format_to straight into one buffer,
+// each followed by a '\0', no allocation per value. clear() keeps the buffer for reuse.
 class Params {
-    std::vector<std::string> data;
-    mutable const char *array[30];
-    typedef std::vector<std::string>::const_iterator iterator;
+    static const int32_t max_params = 30;
+    std::string text;
+    size_t offsets[max_params];
+    int32_t count;
+    mutable const char *array[max_params];
 public:
-    Params() : array() {}
+    Params() : offsets(), count(0), array() {
+        text.reserve(256);
+    }
 
     template<class T>
     Params &add(const T &item) {
-        data.push_back(boost::lexical_cast<std::string>(item));
+        if (count == max_params) {
+            throw std::length_error("too many query parameters");
+        }
+        offsets[count++] = text.size();
+        utilities::lex_format_to(text, item);
+        text += '\0';
         return *this;
     }
 
     // postgres PGexecParams wants an int for the size, fair enough,
     // 2147483647 parameters should suffice :P
-    int32_t size() const { return static_cast<int32_t>(data.size()); }
+    int32_t size() const { return count; }
 
+    // the pointers are good until the next add() or clear()
     const char **get() const {
-        int32_t counter(0);
-        for (iterator iter = data.begin(); iter != data.end(); ++iter) {
-            array[counter++] = iter->c_str();
+        for (int32_t i = 0; i < count; ++i) {
+            array[i] = text.data() + offsets[i];
         }
         return array;
     }
 
     Params &clear() {
-        data.clear();
+        text.clear();
+        count = 0;
         return *this;
     }
 };
@@ -324,6 +357,7 @@ public:
         /* Check to see that the backend connection was successfully made */
         if (PQstatus(conn) != CONNECTION_OK) {
             std::cerr << "Connection to database failed: " << PQerrorMessage(conn);
+            PQfinish(conn);
             conn = nullptr;
         }
     }
@@ -334,6 +368,17 @@ public:
 
     EXPLICIT operator PGconn *() const { return conn; }
 
+private:
+    // good, or brought back with retries
+    bool usable(uint32_t retries, uint32_t retry_sleep_time) const {
+        if (PQstatus(conn) == CONNECTION_OK) {
+            return true;
+        }
+        return retries && check_connection(retries, retry_sleep_time);
+    }
+
+public:
+
     bool check_connection(uint32_t retries = 3, uint32_t retry_delay = 30) const {
         uint32_t retry = 0;
         while (PQstatus(conn) != CONNECTION_OK && retry < retries) {
@@ -351,11 +396,16 @@ public:
         return retry < retries; // true if not all retries were used
     }
 
+    /**
+     * A connection that went bad fails the call right away, nullptr, and a pooled one is
+     * replaced by the pool. retries > 0 reconnects in place instead, sleeping
+     * retry_sleep_time * attempt seconds in between, see check_connection().
+     */
     PGresult *exec(const boost::string_view &query,
                    const Params &values,
                    uint32_t retries = 0,
                    uint32_t retry_sleep_time = 0) const {
-        if (check_connection(retries, retry_sleep_time)) {
+        if (!usable(retries, retry_sleep_time)) {
             return nullptr;
         }
         PGresult *result = PQexecParams(conn,
@@ -372,14 +422,14 @@ public:
     }
 
     PGresult *exec(const boost::string_view &query,
-                   uint32_t retries = 3,
-                   uint32_t retry_sleep_time = 10) const {
-        if (check_connection(retries, retry_sleep_time)) {
-            PGresult *result = PQexec(conn, &query[0]);
-            Scoped_result::check(result);
-            return result;
+                   uint32_t retries = 0,
+                   uint32_t retry_sleep_time = 0) const {
+        if (!usable(retries, retry_sleep_time)) {
+            return nullptr;
         }
-        return nullptr;
+        PGresult *result = PQexec(conn, &query[0]);
+        Scoped_result::check(result);
+        return result;
     }
 
     /**
@@ -387,27 +437,26 @@ public:
      * have been idle in the pool for a period, typically longer than
      * server timout or any reason for the server to hang up.
      * Calling this every time a connection is requested is ofc a bad idea, you decide.
+     * No reconnect attempts, the pool replaces a connection that fails this.
      * @return true if the connection looks fine
      */
     [[nodiscard]]
     bool test_connection() const noexcept {
-        if (check_connection()) {
-            try {
-                PGresult * result = exec("SELECT 1");
-                Scoped_result::check(result);
-                return true;
-            } catch (const std::exception&) { /*failed*/ }
+        if (PQstatus(conn) == CONNECTION_OK) {
+            Scoped_result result(PQexec(conn, "SELECT 1"));
+            return static_cast<bool>(result);
         }
         return false;
     }
 
     /**
-     * connection pool support, allows a pool to decide if the connection is worth keeping
+     * connection pool support, allows a pool to decide if the connection is worth keeping.
+     * No reconnect attempts, they sleep between retries, the pool replaces a bad connection
      * @return true if the connection looks fine
      */
     [[nodiscard]]
     bool good_connection() const noexcept {
-        return check_connection();
+        return PQstatus(conn) == CONNECTION_OK;
     }
 
     /**
@@ -14,6 +14,7 @@
 
 
 #include <hiredis/hiredis.h>
+#include "algorithm.h"
 #include <vector>
 #include <fmt/core.h>
 #include <iostream>
@@ -239,16 +240,14 @@ namespace om_tools {
         }
 
         // TODO SET can return the previous value if updating. this function should perhaps do that too.
+        // numbers, bool and timestamps are formatted on the stack with lex_format, key and value
+        // go as binary safe arguments, spaces and % in them are fine
         template<typename T>
 //        constexpr
         Redis &set(std::string_view key, const T &value, redis_error &err) noexcept {
-            free_reply();
-            err = REDIS_OK;
-            std::string expr = "SET ";
-            expr += key;
-            expr += ' ';
-            expr += value;
-            command(expr, err);
+            char buffer[utilities::lex_format_size];
+            std::string_view text = lex_format(buffer, value);
+            command_format(err, "SET %b %b", key.data(), key.size(), text.data(), text.size());
             if (m_reply == nullptr || m_reply->type == REDIS_REPLY_ERROR) {
                 err = m_ctx.error();
             }
@@ -522,6 +521,20 @@ namespace om_tools {
             return m_ctx.good();
         }
 
+        /**
+         * connection pool support, PING the server to see if a connection that
+         * has been idle in the pool for a while is still alive
+         * @return true if the server answered
+         */
+        [[nodiscard]]
+        bool test_connection() noexcept {
+            redis_error err = REDIS_OK;
+            command("PING", err);
+            bool alive = err == REDIS_OK && good();
+            free_reply();
+            return alive;
+        }
+
         /**
          * Drop any old response
          */
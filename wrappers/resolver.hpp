@@ -0,0 +1,328 @@
+#pragma once
+
+/**
+ * A process wide cache of getaddrinfo() results, so a new connection doesn't wait for the
+ * name server every time, or stall on a slow one.
+ *
+ * getaddrinfo() doesn't tell the DNS TTL, so an answer is fresh for Resolver_config::ttl. After
+ * that it is still served, stale, for serve_stale, while a resolver thread looks it up
+ * again in the background, and if that lookup fails the stale answer stays. A name that
+ * doesn't resolve is remembered for negative_ttl, so a bad host name doesn't cost a
+ * lookup per connection attempt either.
+ *
+ * Lookups run on a few resolver threads. Callers that want the same name at the same time
+ * wait for the same lookup. Addr_info uses Resolver::instance() for TCP.
+ *
+ * Usage:
+ *  addrinfo hints{};
+ *  hints.ai_family = AF_UNSPEC;
+ *  hints.ai_socktype = SOCK_STREAM;
+ *  auto resolution = Resolver::instance().resolve("db.example.com", "5432", hints);
+ *  if (!resolution) {
+ *      std::clog << gai_strerror(resolution.error) << '\n';
+ *  }
+ *  for (const addrinfo *rp = resolution.addresses.get(); rp; rp = rp->ai_next) ...
+ */
+
+#include <netdb.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace om_tools {
+#if __cplusplus >= 201103L
+inline namespace v1_0_0 {
+#endif
+
+struct Resolver_config {
+    // served without a lookup this long
+    std::chrono::milliseconds ttl{std::chrono::seconds(30)};
+    // and after that, while it is looked up again, this long
+    std::chrono::milliseconds serve_stale{std::chrono::minutes(5)};
+    // a name that didn't resolve isn't looked up again for this long
+    std::chrono::milliseconds negative_ttl{std::chrono::seconds(5)};
+    size_t threads{2};
+    // names kept, the ones expired the longest go first
+    size_t max_entries{1024};
+};
+
+struct Resolution {
+    // shared with the cache, freed with freeaddrinfo() when the last one lets go
+    std::shared_ptr<const addrinfo> addresses;
+    // EAI_ code from getaddrinfo(), 0 if resolved
+    int error{0};
+
+    explicit operator bool() const { return addresses != nullptr; }
+};
+
+struct Resolver_stats {
+    uint64_t hits{0};
+    uint64_t stale_hits{0};
+    uint64_t negative_hits{0};
+    // getaddrinfo() calls
+    uint64_t lookups{0};
+    uint64_t failures{0};
+};
+
+class Resolver {
+public:
+    using clock = std::chrono::steady_clock;
+
+private:
+    struct Job {
+        std::string key;
+        std::string host;
+        std::string port;
+        addrinfo hints;
+    };
+
+    struct Entry {
+        Resolution resolution;
+        bool resolved{false};
+        clock::time_point fresh_until;
+        clock::time_point stale_until;
+        // valid while a lookup runs
+        std::shared_ptr<std::promise<Resolution>> promise;
+        std::shared_future<Resolution> pending;
+    };
+
+    const Resolver_config m_config;
+    std::mutex m_mutex;
+    std::condition_variable m_work;
+    std::unordered_map<std::string, Entry> m_entries;
+    std::deque<Job> m_jobs;
+    Resolver_stats m_stats;
+    bool m_stopping{false};
+    std::vector<std::thread> m_threads;
+
+    static std::string make_key(std::string_view host, std::string_view port, const addrinfo &hints) {
+        std::string key;
+        key.reserve(host.size() + port.size() + 24);
+        key.append(host).append(1, '\0').append(port).append(1, '\0');
+        key.append(std::to_string(hints.ai_family)).append(1, ',');
+        key.append(std::to_string(hints.ai_socktype)).append(1, ',');
+        key.append(std::to_string(hints.ai_protocol)).append(1, ',');
+        key.append(std::to_string(hints.ai_flags));
+        return key;
+    }
+
+    // a lookup for entry, under the lock
+    void schedule(Entry &entry, std::string key, std::string_view host, std::string_view port, const addrinfo &hints) {
+        entry.promise = std::make_shared<std::promise<Resolution>>();
+        entry.pending = entry.promise->get_future().share();
+        addrinfo job_hints{};
+        job_hints.ai_family = hints.ai_family;
+        job_hints.ai_socktype = hints.ai_socktype;
+        job_hints.ai_protocol = hints.ai_protocol;
+        job_hints.ai_flags = hints.ai_flags;
+        m_jobs.push_back(Job{std::move(key), std::string(host), std::string(port), job_hints});
+        m_work.notify_one();
+    }
+
+    // room for one more, under the lock
+    void make_room(clock::time_point now) {
+        if (m_entries.size() < m_config.max_entries) {
+            return;
+        }
+        auto victim = m_entries.end();
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+            if (it->second.promise) {
+                // callers are waiting for it
+                continue;
+            }
+            if (victim == m_entries.end() || it->second.stale_until < victim->second.stale_until) {
+                victim = it;
+            }
+            if (victim->second.stale_until <= now) {
+                break;
+            }
+        }
+        if (victim != m_entries.end()) {
+            m_entries.erase(victim);
+        }
+    }
+
+    void finish(const Job &job, Resolution resolution) {
+        std::shared_ptr<std::promise<Resolution>> promise;
+        {
+            std::lock_guard lock(m_mutex);
+            auto found = m_entries.find(job.key);
+            if (found == m_entries.end()) {
+                return;
+            }
+            Entry &entry = found->second;
+            const auto now = clock::now();
+            ++m_stats.lookups;
+            if (resolution) {
+                entry.resolution = resolution;
+                entry.fresh_until = now + m_config.ttl;
+                entry.stale_until = entry.fresh_until + m_config.serve_stale;
+            } else {
+                ++m_stats.failures;
+                if (entry.resolution && now < entry.stale_until) {
+                    // keep serving the stale one, try again later
+                    resolution = entry.resolution;
+                } else {
+                    entry.resolution = resolution;
+                    entry.stale_until = now + m_config.negative_ttl;
+                }
+                entry.fresh_until = now + m_config.negative_ttl;
+            }
+            entry.resolved = true;
+            promise = std::move(entry.promise);
+            entry.promise.reset();
+            entry.pending = {};
+        }
+        promise->set_value(std::move(resolution));
+    }
+
+    void work() {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock lock(m_mutex);
+                m_work.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+                if (m_jobs.empty()) {
+                    return;
+                }
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+            }
+            addrinfo *result = nullptr;
+            Resolution resolution;
+            resolution.error = ::getaddrinfo(job.host.empty() ? nullptr : job.host.c_str(),
+                                             job.port.empty() ? nullptr : job.port.c_str(), &job.hints, &result);
+            if (resolution.error == 0) {
+                resolution.addresses = std::shared_ptr<const addrinfo>(result, ::freeaddrinfo);
+            }
+            finish(job, std::move(resolution));
+        }
+    }
+
+    /**
+     * The cached answer, under the lock, or the lookup to wait for. Starts a lookup if
+     * there is no fresh answer and none is running.
+     */
+    std::shared_future<Resolution> lookup(std::string_view host, std::string_view port, const addrinfo &hints,
+                                          Resolution &cached) {
+        std::string key = make_key(host, port, hints);
+        const auto now = clock::now();
+        std::lock_guard lock(m_mutex);
+        auto found = m_entries.find(key);
+        if (found == m_entries.end()) {
+            make_room(now);
+            found = m_entries.emplace(key, Entry{}).first;
+        }
+        Entry &entry = found->second;
+        if (entry.resolved && now < entry.fresh_until) {
+            ++(entry.resolution ? m_stats.hits : m_stats.negative_hits);
+            cached = entry.resolution;
+            return {};
+        }
+        if (!entry.promise) {
+            schedule(entry, std::move(key), host, port, hints);
+        }
+        if (entry.resolved && entry.resolution && now < entry.stale_until) {
+            ++m_stats.stale_hits;
+            cached = entry.resolution;
+            return {};
+        }
+        return entry.pending;
+    }
+
+public:
+    explicit Resolver(const Resolver_config &config = {}) : m_config(config) {
+        for (size_t i = 0; i < std::max<size_t>(m_config.threads, 1); ++i) {
+            m_threads.emplace_back(&Resolver::work, this);
+        }
+    }
+
+    Resolver(const Resolver &) = delete;
+
+    Resolver &operator=(const Resolver &) = delete;
+
+    // waits for the lookups that are running
+    ~Resolver() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+            m_jobs.clear();
+        }
+        m_work.notify_all();
+        for (auto &thread: m_threads) {
+            thread.join();
+        }
+        for (auto &[key, entry]: m_entries) {
+            if (entry.promise) {
+                Resolution stopped;
+                stopped.error = EAI_AGAIN;
+                entry.promise->set_value(stopped);
+            }
+        }
+    }
+
+    // the one Addr_info uses
+    static Resolver &instance() {
+        static Resolver resolver;
+        return resolver;
+    }
+
+    /**
+     * Addresses for host and port, from the cache if it has them, fresh or stale,
+     * otherwise waits for a resolver thread to look them up.
+     * Only family, socktype, protocol and flags of hints are used.
+     */
+    Resolution resolve(std::string_view host, std::string_view port, const addrinfo &hints) {
+        Resolution cached;
+        auto pending = lookup(host, port, hints, cached);
+        return pending.valid() ? pending.get() : cached;
+    }
+
+    // the same, without waiting, the future is ready at once if it was cached
+    std::shared_future<Resolution> resolve_async(std::string_view host, std::string_view port,
+                                                 const addrinfo &hints) {
+        Resolution cached;
+        auto pending = lookup(host, port, hints, cached);
+        if (pending.valid()) {
+            return pending;
+        }
+        std::promise<Resolution> ready;
+        ready.set_value(std::move(cached));
+        return ready.get_future().share();
+    }
+
+    // forget the answers, the lookups that are running finish
+    void clear() {
+        std::lock_guard lock(m_mutex);
+        for (auto it = m_entries.begin(); it != m_entries.end();) {
+            it = it->second.promise ? std::next(it) : m_entries.erase(it);
+        }
+    }
+
+    [[nodiscard]]
+    Resolver_stats stats() {
+        std::lock_guard lock(m_mutex);
+        return m_stats;
+    }
+
+    [[nodiscard]]
+    size_t size() {
+        std::lock_guard lock(m_mutex);
+        return m_entries.size();
+    }
+};
+
+#if __cplusplus >= 201103L
+}
+#endif
+}
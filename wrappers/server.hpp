@@ -0,0 +1,290 @@
+#pragma once
+
+/**
+ * A TCP server on all cores, N worker threads, each with its own SO_REUSEPORT listener
+ * on the same port and its own Event_loop. The kernel spreads the clients over the
+ * listeners, there is no shared accept queue or lock, and a client is served start to
+ * end on the thread that accepted it.
+ *
+ * pin_cpus() pins worker i to CPU first + i, so its loop, sockets and buffers stay in that
+ * CPU's caches. steer_by_cpu() goes one further, with pinned workers, and has the kernel
+ * give a client to the worker on the CPU its packets arrive on, rather than by hash.
+ * start() throws if the kernel won't take the program, steering() tells it is in place.
+ *
+ * profile() sets socket options on the listeners, the clients inherit them, all but
+ * quick_ack which is set on each client. Pinned listeners also get SO_INCOMING_CPU.
+ *
+ * The accept handler runs on the worker's thread, with the worker's loop, to add() the
+ * client to it. A handler that throws is logged, and the worker carries on.
+ *
+ * Usage:
+ *  Server server;
+ *  server.port("8080").workers(16).pin_cpus().on_accept([](Event_loop &loop, Socket client) {
+ *      loop.add(std::move(client), Event_loop::readable, ...);
+ *  }).start();
+ *  ...
+ *  server.stop();
+ */
+
+#include "event_loop.hpp"
+#include "ip_socket.hpp"
+#include <linux/filter.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace om_tools {
+namespace descriptors {
+
+#if __cplusplus >= 201103L
+inline namespace v1_0_0 {
+#endif
+
+class Server {
+public:
+    using Accept_handler = std::function<void(Event_loop &loop, Socket client)>;
+    using Start_handler = std::function<void(Event_loop &loop, size_t worker)>;
+
+private:
+    std::string m_port;
+    size_t m_workers{std::max(std::thread::hardware_concurrency(), 1u)};
+    size_t m_accept_batch{64};
+    bool m_pin{false};
+    size_t m_first_cpu{0};
+    bool m_steer{false};
+    Socket_profile m_profile;
+    Accept_handler m_on_accept;
+    Start_handler m_on_start;
+    uint16_t m_bound_port{0};
+    bool m_steering{false};
+    std::vector<std::unique_ptr<Event_loop>> m_loops;
+    std::vector<std::thread> m_threads;
+
+    static uint16_t local_port(const Socket &socket) {
+        sockaddr_in address{};
+        socklen_t length = sizeof address;
+        if (::getsockname(socket.get(), reinterpret_cast<sockaddr *>(&address), &length) == -1) {
+            throw std::system_error(errno, std::generic_category(), "getsockname");
+        }
+        return ntohs(address.sin_port);
+    }
+
+    void attach_cpu_steering(const Socket &listener) const {
+        auto code = steering_program(m_first_cpu, m_workers, cpus());
+        sock_fprog program{static_cast<unsigned short>(code.size()), code.data()};
+        if (::setsockopt(listener.get(), SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof program) == -1) {
+            throw std::system_error(errno, std::generic_category(), "SO_ATTACH_REUSEPORT_CBPF");
+        }
+    }
+
+    static size_t cpus() {
+        return std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    size_t cpu_of(size_t worker) const {
+        return cpu_of(worker, m_first_cpu, cpus());
+    }
+
+    void pin(size_t worker) const {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu_of(worker), &set);
+        if (int error = ::pthread_setaffinity_np(::pthread_self(), sizeof set, &set); error != 0) {
+            std::clog << __FUNCTION__ << ": worker " << worker << " not pinned: " << strerror(error) << '\n';
+        }
+    }
+
+    void work(size_t worker) {
+        if (m_pin) {
+            pin(worker);
+        }
+        Event_loop &loop = *m_loops[worker];
+        if (m_on_start) {
+            m_on_start(loop, worker);
+        }
+        for (;;) {
+            try {
+                loop.run();
+                return;
+            } catch (const std::exception &e) {
+                std::clog << "Server worker " << worker << ": " << e.what() << '\n';
+            }
+        }
+    }
+
+public:
+    // the CPU pin_cpus(first_cpu) pins worker to, wrapping around at cpus
+    static size_t cpu_of(size_t worker, size_t first_cpu, size_t cpus) {
+        return (first_cpu + worker) % cpus;
+    }
+
+    /**
+     * What steer_by_cpu() attaches, a reuseport group picks the listener by what it returns.
+     * That is the worker cpu_of() pins to the receiving CPU, (cpu - first_cpu) mod cpus,
+     * kept unsigned by adding cpus first. A CPU without a worker, with fewer workers than
+     * CPUs, goes to worker index % workers.
+     */
+    static std::vector<sock_filter> steering_program(size_t first_cpu, size_t workers, size_t cpus) {
+        return {
+            {BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)},
+            {BPF_ALU | BPF_ADD | BPF_K, 0, 0, static_cast<uint32_t>(cpus - first_cpu % cpus)},
+            {BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<uint32_t>(cpus)},
+            {BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<uint32_t>(workers)},
+            {BPF_RET | BPF_A, 0, 0, 0},
+        };
+    }
+
+    Server() = default;
+
+    Server(const Server &) = delete;
+
+    Server &operator=(const Server &) = delete;
+
+    ~Server() { stop(); }
+
+    // the port to listen to, "0" for any free one, see bound_port()
+    Server &port(std::string_view port) {
+        m_port = port;
+        return *this;
+    }
+
+    // number of threads, each with a listener and loop, the number of CPUs by default
+    Server &workers(size_t count) {
+        m_workers = std::max<size_t>(count, 1);
+        return *this;
+    }
+
+    // clients accepted in a row by a worker before its other sockets get a turn
+    Server &accept_batch(size_t batch) {
+        m_accept_batch = batch;
+        return *this;
+    }
+
+    // pin worker i to CPU first_cpu + i, wrapping around
+    Server &pin_cpus(size_t first_cpu = 0) {
+        m_pin = true;
+        m_first_cpu = first_cpu;
+        return *this;
+    }
+
+    // give each client to the worker pinned to the CPU that receives it, implies pin_cpus()
+    Server &steer_by_cpu() {
+        m_pin = true;
+        m_steer = true;
+        return *this;
+    }
+
+    // options for the listeners and clients, Socket_profile::low_latency_rpc() perhaps
+    Server &profile(const Socket_profile &profile) {
+        m_profile = profile;
+        return *this;
+    }
+
+    Server &on_accept(Accept_handler handler) {
+        m_on_accept = std::move(handler);
+        return *this;
+    }
+
+    // called on each worker's thread before it starts serving, for its timers perhaps
+    Server &on_start(Start_handler handler) {
+        m_on_start = std::move(handler);
+        return *this;
+    }
+
+    /**
+     * Listen, all workers on the same port, and start the threads.
+     * throws std::invalid_argument without port or accept handler, std::system_error or
+     * std::runtime_error if it can't listen, or can't attach steer_by_cpu()'s program,
+     * nothing is started then
+     */
+    void start() {
+        if (m_port.empty() || !m_on_accept) {
+            throw std::invalid_argument("Server needs a port and an accept handler");
+        }
+        if (!m_threads.empty()) {
+            throw std::logic_error("Server already started");
+        }
+        std::vector<std::unique_ptr<Event_loop>> loops;
+        std::string port = m_port;
+        for (size_t worker = 0; worker < m_workers; ++worker) {
+            Socket_profile profile = m_profile;
+            if (m_pin) {
+                profile.incoming_cpu = static_cast<int>(cpu_of(worker));
+            }
+            Socket listener = Socket::create_tcp_server_socket(port, true, profile);
+            if (!listener.valid()) {
+                throw std::runtime_error("Server can't listen on port " + port);
+            }
+            if (worker == 0) {
+                // the rest join the port the first one got
+                m_bound_port = local_port(listener);
+                port = std::to_string(m_bound_port);
+                if (m_steer) {
+                    attach_cpu_steering(listener);
+                }
+            }
+            auto loop = std::make_unique<Event_loop>();
+            loop->listen(std::move(listener), [&loop = *loop, this](Socket client) {
+                if (m_profile.quick_ack) {
+                    // not inherited from the listener
+                    Socket_profile quick_ack;
+                    quick_ack.quick_ack = m_profile.quick_ack;
+                    client.apply(quick_ack);
+                }
+                m_on_accept(loop, std::move(client));
+            }, m_accept_batch);
+            loops.push_back(std::move(loop));
+        }
+        m_loops = std::move(loops);
+        m_steering = m_steer;
+        for (size_t worker = 0; worker < m_workers; ++worker) {
+            m_threads.emplace_back(&Server::work, this, worker);
+        }
+    }
+
+    // stop the loops and wait for the workers, the sockets are closed
+    void stop() {
+        for (auto &loop: m_loops) {
+            loop->stop();
+        }
+        for (auto &thread: m_threads) {
+            thread.join();
+        }
+        m_threads.clear();
+        m_loops.clear();
+        m_steering = false;
+    }
+
+    // the port listened to, the one picked for "0"
+    [[nodiscard]]
+    uint16_t bound_port() const noexcept { return m_bound_port; }
+
+    [[nodiscard]]
+    size_t worker_count() const noexcept { return m_loops.size(); }
+
+    // started with the steer_by_cpu() program attached, rather than the kernel's hash
+    [[nodiscard]]
+    bool steering() const noexcept { return m_steering; }
+};
+
+#if __cplusplus >= 201103L
+}
+#endif
+
+}
+using descriptors::Server;
+}